@@ -0,0 +1,248 @@
+/*
+ * bench.c - Repeated measurements summarized with confidence intervals
+ *
+ * A sample is an outlier if it lies more than 1.5 interquartile ranges
+ * outside the middle half of the samples. The bootstrap draws the
+ * kept samples with replacement BENCH_RESAMPLES times, takes the
+ * median of each draw, and uses the 2.5th and 97.5th percentiles of
+ * those medians as the interval. Its generator has a fixed seed, so
+ * the same samples always give the same interval.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+
+#include "bench.h"
+
+static cpu_set_t unpinned;  /* CPUs the thread had before bench_pin */
+static int pinned = 0;      /* ... and is it pinned now? */
+
+/*
+ * cmp_double - qsort order of doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * quantile - The q quantile of the n sorted values in x, interpolating
+ *     between the two values on either side of it
+ */
+static double quantile(double *x, int n, double q)
+{
+    double pos = q * (n - 1);
+    int i = (int)pos;
+
+    if (i + 1 >= n)
+	return x[n - 1];
+    return x[i] + (pos - i) * (x[i + 1] - x[i]);
+}
+
+/*
+ * next_rand - Next number from a fixed-seed xorshift generator
+ */
+static unsigned int next_rand(unsigned int *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+/*
+ * bench_summarize - Drop the outliers from the n samples in x, then
+ *     take the median and bootstrap its confidence interval
+ */
+void bench_summarize(double *x, int n, bench_t *b)
+{
+    static double draw[BENCH_MAX_RUNS];
+    static double medians[BENCH_RESAMPLES];
+    double q1, q3, iqr;
+    unsigned int seed = 2463534242u;
+    int i, j, k;
+
+    memset(b, 0, sizeof(*b));
+    if (n > BENCH_MAX_RUNS)
+	n = BENCH_MAX_RUNS;
+    b->runs = n;
+    if (n == 0)
+	return;
+
+    /* Keep the samples inside Tukey's fences, at the front of x */
+    qsort(x, n, sizeof(double), cmp_double);
+    q1 = quantile(x, n, 0.25);
+    q3 = quantile(x, n, 0.75);
+    iqr = q3 - q1;
+    for (i = k = 0; i < n; i++)
+	if (x[i] >= q1 - 1.5 * iqr && x[i] <= q3 + 1.5 * iqr)
+	    x[k++] = x[i];
+    b->kept = k;
+    b->median = quantile(x, k, 0.5);
+    for (i = 0; i < k; i++)
+	b->mean += x[i] / k;
+    for (i = 0; i < k; i++)
+	b->sd += (x[i] - b->mean) * (x[i] - b->mean);
+    b->sd = (k > 1) ? sqrt(b->sd / (k - 1)) : 0;
+
+    for (j = 0; j < BENCH_RESAMPLES; j++) {
+	for (i = 0; i < k; i++)
+	    draw[i] = x[next_rand(&seed) % k];
+	qsort(draw, k, sizeof(double), cmp_double);
+	medians[j] = quantile(draw, k, 0.5);
+    }
+    qsort(medians, BENCH_RESAMPLES, sizeof(double), cmp_double);
+    b->lo = quantile(medians, BENCH_RESAMPLES, 0.025);
+    b->hi = quantile(medians, BENCH_RESAMPLES, 0.975);
+}
+
+/*
+ * beta_frac - Continued fraction for the incomplete beta function, by
+ *     the modified Lentz method
+ */
+static double beta_frac(double a, double b, double x)
+{
+    double c = 1, d, h, del, aa;
+    int m;
+
+    d = 1 - (a + b) * x / (a + 1);
+    d = (fabs(d) < 1e-300) ? 1e300 : 1 / d;
+    h = d;
+    for (m = 1; m <= 300; m++) {
+	aa = m * (b - m) * x / ((a + 2*m - 1) * (a + 2*m));
+	d = 1 + aa * d;
+	d = (fabs(d) < 1e-300) ? 1e300 : 1 / d;
+	c = 1 + aa / c;
+	c = (fabs(c) < 1e-300) ? 1e-300 : c;
+	h *= d * c;
+	aa = -(a + m) * (a + b + m) * x / ((a + 2*m) * (a + 2*m + 1));
+	d = 1 + aa * d;
+	d = (fabs(d) < 1e-300) ? 1e300 : 1 / d;
+	c = 1 + aa / c;
+	c = (fabs(c) < 1e-300) ? 1e-300 : c;
+	del = d * c;
+	h *= del;
+	if (fabs(del - 1) < 1e-12)
+	    break;
+    }
+    return h;
+}
+
+/*
+ * beta_inc - The regularized incomplete beta function I_x(a, b)
+ */
+static double beta_inc(double a, double b, double x)
+{
+    double front;
+
+    if (x <= 0)
+	return 0;
+    if (x >= 1)
+	return 1;
+    front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + 
+		a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+	return front * beta_frac(a, b, x) / a;
+    return 1 - front * beta_frac(b, a, 1 - x) / b;
+}
+
+/*
+ * bench_pvalue - Welch's t statistic and its degrees of freedom, and
+ *     the chance of a |t| that large under Student's t distribution
+ */
+double bench_pvalue(bench_t *a, bench_t *b)
+{
+    double va, vb, t, df;
+
+    if (a->kept < 2 || b->kept < 2)
+	return -1;
+    va = a->sd * a->sd / a->kept;
+    vb = b->sd * b->sd / b->kept;
+    if (va + vb == 0)
+	return (a->mean == b->mean) ? 1 : 0;
+    t = (a->mean - b->mean) / sqrt(va + vb);
+    df = (va + vb) * (va + vb) / 
+	(va * va / (a->kept - 1) + vb * vb / (b->kept - 1));
+    return beta_inc(df / 2, 0.5, df / (df + t * t));
+}
+
+/*
+ * bench_pin - Pin this thread to its current CPU, so that the runs are
+ *     not spread over CPUs with different caches and clock speeds. The
+ *     CPUs it could use before are kept for bench_unpin.
+ */
+int bench_pin(void)
+{
+    cpu_set_t set;
+    int cpu;
+
+    if (sched_getaffinity(0, sizeof(unpinned), &unpinned) < 0)
+	return -1;
+    if ((cpu = sched_getcpu()) < 0)
+	return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	return -1;
+    pinned = 1;
+    return cpu;
+}
+
+/*
+ * bench_unpin - Let this thread run on the CPUs it had before bench_pin
+ */
+void bench_unpin(void)
+{
+    if (pinned)
+	sched_setaffinity(0, sizeof(unpinned), &unpinned);
+    pinned = 0;
+}
+
+/*
+ * bench_governor - Read cpu's scaling governor from sysfs
+ */
+char *bench_governor(int cpu)
+{
+    static char gov[64];
+    char path[128];
+    FILE *fp;
+
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",
+	    cpu);
+    if ((fp = fopen(path, "r")) == NULL)
+	return NULL;
+    if (fgets(gov, sizeof(gov), fp) == NULL) {
+	fclose(fp);
+	return NULL;
+    }
+    fclose(fp);
+    gov[strcspn(gov, "\n")] = '\0';
+    return gov;
+}
+
+/*
+ * bench_slow_cpu - Find a CPU this thread may run on whose governor is
+ *     known and is not "performance"
+ */
+int bench_slow_cpu(char **gov)
+{
+    cpu_set_t set;
+    int cpu;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0)
+	return -1;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+	if (!CPU_ISSET(cpu, &set))
+	    continue;
+	if ((*gov = bench_governor(cpu)) != NULL && 
+	    strcmp(*gov, "performance") != 0)
+	    return cpu;
+    }
+    return -1;
+}
@@ -0,0 +1,42 @@
+/*
+ * bench.h - Repeated measurements summarized with confidence intervals
+ *
+ * A set of throughput samples is cleaned of outliers with Tukey's
+ * fences, and summarized by its median together with a 95% confidence
+ * interval for that median from a percentile bootstrap. Two summaries
+ * can be compared with Welch's t-test on their kept samples.
+ */
+
+#define BENCH_MAX_RUNS  1000   /* most samples a summary takes */
+#define BENCH_RESAMPLES 2000   /* bootstrap resamples per interval */
+
+/* Summary of one set of samples */
+typedef struct {
+    int runs;          /* samples taken */
+    int kept;          /* samples left once the outliers are dropped */
+    double median;     /* median of the kept samples */
+    double lo, hi;     /* 95% confidence interval for the median */
+    double mean, sd;   /* mean and standard deviation of the kept samples */
+} bench_t;
+
+/* Summarize the n samples in x, which are reordered */
+void bench_summarize(double *x, int n, bench_t *b);
+
+/* Two-sided p-value of Welch's t-test for equal means of a and b, or
+   -1 if either has fewer than two kept samples */
+double bench_pvalue(bench_t *a, bench_t *b);
+
+/* Pin the calling thread to the CPU it is running on, and return
+   that CPU, or -1 if it cannot be pinned */
+int bench_pin(void);
+
+/* Give the calling thread back the CPUs it had before bench_pin */
+void bench_unpin(void);
+
+/* The cpufreq governor of cpu, or NULL if it has none that can be
+   read. The string is static. */
+char *bench_governor(int cpu);
+
+/* The first CPU the calling thread may run on with a governor other
+   than "performance", which goes in *gov, or -1 if there is none */
+int bench_slow_cpu(char **gov);
@@ -0,0 +1,192 @@
+/*
+ * cachesim.c - A simulated L1/L2/LLC cache hierarchy
+ *
+ * A level keeps a tag and a last-use stamp for each way of each set.
+ * A line maps to set (line number mod sets), so the set counts need not
+ * be powers of two. The levels are neither inclusive nor exclusive: a
+ * line evicted from one may stay in the others.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cachesim.h"
+
+/* One level of the hierarchy */
+typedef struct {
+    unsigned long size;        /* bytes */
+    int ways;
+    unsigned long sets;
+    unsigned long *tags;       /* sets*ways line numbers plus one, 0 if empty */
+    unsigned long long *used;  /* ... and the clock when each was last used */
+} level_t;
+
+static level_t levels[CACHESIM_LEVELS];
+static cachesim_counts_t counts;
+static unsigned long long clock_now = 0;  /* accesses so far, for LRU */
+static int active = 0;
+
+static char *names[CACHESIM_LEVELS] = { "L1", "L2", "LLC" };
+
+/*
+ * parse_size - Read a size with an optional K, M or G suffix from *s,
+ *     and move *s past it. Returns 0 if there is none.
+ */
+static unsigned long parse_size(char **s)
+{
+    char *end;
+    unsigned long size = strtoul(*s, &end, 10);
+
+    switch (*end) {
+    case 'G': case 'g': size <<= 10; /* fall through */
+    case 'M': case 'm': size <<= 10; /* fall through */
+    case 'K': case 'k': size <<= 10; end++; break;
+    }
+    if (end == *s)
+	return 0;
+    *s = end;
+    return size;
+}
+
+/*
+ * cachesim_config - Parse spec into new levels, and only once all of
+ *     them are good replace the old ones
+ */
+int cachesim_config(char *spec)
+{
+    level_t lv[CACHESIM_LEVELS];
+    char *s = (spec != NULL) ? spec : CACHESIM_DEFAULT;
+    char *end;
+    int i;
+
+    for (i = 0; i < CACHESIM_LEVELS; i++) {
+	if (i > 0 && *s++ != ',')
+	    return -1;
+	lv[i].size = parse_size(&s);
+	if (lv[i].size == 0 || *s++ != ':')
+	    return -1;
+	lv[i].ways = strtol(s, &end, 10);
+	if (end == s || lv[i].ways < 1 ||
+	    lv[i].size % ((unsigned long)lv[i].ways * CACHESIM_LINE) != 0)
+	    return -1;
+	s = end;
+	lv[i].sets = lv[i].size / ((unsigned long)lv[i].ways * CACHESIM_LINE);
+    }
+    if (*s != '\0')
+	return -1;
+
+    for (i = 0; i < CACHESIM_LEVELS; i++) {
+	free(levels[i].tags);
+	free(levels[i].used);
+	levels[i] = lv[i];
+	levels[i].tags = calloc(lv[i].sets * lv[i].ways, sizeof(unsigned long));
+	levels[i].used = calloc(lv[i].sets * lv[i].ways,
+				sizeof(unsigned long long));
+	if (levels[i].tags == NULL || levels[i].used == NULL) {
+	    fprintf(stderr, "cachesim: out of memory for %s\n", names[i]);
+	    exit(1);
+	}
+    }
+    cachesim_reset(active);
+    return 0;
+}
+
+/*
+ * cachesim_reset - Empty the levels, set up the default ones first if
+ *     there are none yet
+ */
+void cachesim_reset(int on)
+{
+    level_t *lv;
+    int i;
+
+    if (levels[0].tags == NULL)
+	cachesim_config(NULL);
+    for (i = 0; i < CACHESIM_LEVELS; i++) {
+	lv = &levels[i];
+	memset(lv->tags, 0, lv->sets * lv->ways * sizeof(unsigned long));
+	memset(lv->used, 0, lv->sets * lv->ways * sizeof(unsigned long long));
+    }
+    memset(&counts, 0, sizeof(counts));
+    clock_now = 0;
+    active = on;
+}
+
+/*
+ * lookup - Look for line in lv, and fill it into the least recently
+ *     used way of its set if it is not there. Returns 1 on a hit.
+ */
+static int lookup(level_t *lv, unsigned long line)
+{
+    unsigned long *tags = lv->tags + (line % lv->sets) * lv->ways;
+    unsigned long long *used = lv->used + (line % lv->sets) * lv->ways;
+    int w, lru = 0;
+
+    for (w = 0; w < lv->ways; w++) {
+	if (tags[w] == line + 1) {
+	    used[w] = clock_now;
+	    return 1;
+	}
+	if (used[w] < used[lru])
+	    lru = w;
+    }
+    tags[lru] = line + 1;
+    used[lru] = clock_now;
+    return 0;
+}
+
+/*
+ * cachesim_access - Look up each line the bytes touch, level by level
+ */
+void cachesim_access(unsigned long addr, unsigned long len)
+{
+    unsigned long line, last;
+    int i;
+
+    if (!active || len == 0)
+	return;
+    last = (addr + len - 1) / CACHESIM_LINE;
+    for (line = addr / CACHESIM_LINE; line <= last; line++) {
+	counts.accesses++;
+	clock_now++;
+	for (i = 0; i < CACHESIM_LEVELS && !lookup(&levels[i], line); i++)
+	    counts.misses[i]++;
+    }
+}
+
+/*
+ * cachesim_counts - Copy out the counts
+ */
+void cachesim_counts(cachesim_counts_t *c)
+{
+    *c = counts;
+}
+
+/*
+ * cachesim_level - Size and ways of level i, in a static buffer
+ */
+char *cachesim_level(int i)
+{
+    static char buf[32];
+    unsigned long size = levels[i].size;
+    char *unit = "";
+
+    if (size % (1UL << 20) == 0) {
+	size >>= 20;
+	unit = "M";
+    }
+    else if (size % (1UL << 10) == 0) {
+	size >>= 10;
+	unit = "K";
+    }
+    sprintf(buf, "%lu%s %d-way", size, unit, levels[i].ways);
+    return buf;
+}
+
+/*
+ * cachesim_name - Short name of level i
+ */
+char *cachesim_name(int i)
+{
+    return names[i];
+}
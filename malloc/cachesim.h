@@ -0,0 +1,44 @@
+/*
+ * cachesim.h - A simulated L1/L2/LLC cache hierarchy
+ *
+ * Each level is set associative with LRU replacement and lines of
+ * CACHESIM_LINE bytes. An access looks in each level in turn until one
+ * has the line, and fills it into every level that missed. Nothing is
+ * ever timed, so the same accesses always give the same miss counts,
+ * however loaded the machine is.
+ */
+
+#define CACHESIM_LINE   64
+#define CACHESIM_LEVELS 3    /* L1, L2 and LLC */
+
+/* The hierarchy cachesim_config sets up when given NULL */
+#define CACHESIM_DEFAULT "32K:8,1M:16,32M:16"
+
+/* Accesses and misses at each level since the last cachesim_reset */
+typedef struct {
+    unsigned long long accesses;  /* cache lines looked up in L1 */
+    unsigned long long misses[CACHESIM_LEVELS];
+} cachesim_counts_t;
+
+/* Set up the levels from spec, "size:ways,size:ways,size:ways" with K,
+   M or G suffixes on the sizes, and empty them. Returns -1, leaving
+   the old hierarchy, if the spec is malformed or a size is not a
+   multiple of its ways times the line size. */
+int cachesim_config(char *spec);
+
+/* Empty every level, zero the counts and turn the simulation on or off.
+   It starts off; cachesim_access does nothing while it is off. */
+void cachesim_reset(int on);
+
+/* Look up each line of the len bytes at addr. Addresses need only be
+   numbered the same way from run to run, like offsets into a heap. */
+void cachesim_access(unsigned long addr, unsigned long len);
+
+/* Read the counts into *c */
+void cachesim_counts(cachesim_counts_t *c);
+
+/* Describe level i, as in "32K 8-way", for reports */
+char *cachesim_level(int i);
+
+/* Short name of level i, for reports */
+char *cachesim_name(int i);
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/times.h>
+#include <time.h>
 #include "clock.h"
 
 
@@ -71,6 +72,35 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+/* 
+ * get_tsc_serial - Read the time stamp counter for timing a short stretch
+ * of code. rdtscp waits for all earlier instructions to complete, the
+ * lfence in front keeps earlier loads from being reordered past it, and
+ * the one after it keeps later instructions from starting before the read.
+ */
+unsigned long long get_tsc_serial()
+{
+    unsigned hi, lo;
+
+    asm volatile("lfence; rdtscp; lfence"
+		 : "=d" (hi), "=a" (lo)
+		 : /* No input */
+		 : "%rcx", "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* 
+ * get_tsc - Read the time stamp counter without waiting for anything,
+ * for stretches so short that the fences would cost more than they take
+ */
+unsigned long long get_tsc()
+{
+    unsigned hi, lo;
+
+    asm volatile("rdtsc" : "=d" (hi), "=a" (lo));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -160,6 +190,43 @@ double get_counter()
 }
 #endif
 
+#if !defined(__x86_64__)
+/* 
+ * get_tsc_serial, get_tsc - Without a usable cycle counter, fall back on
+ * the monotonic clock in nanoseconds
+ */
+unsigned long long get_tsc_serial()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned long long get_tsc()
+{
+    return get_tsc_serial();
+}
+#endif
+
+/* 
+ * tsc_serial_ovhd - Smallest number of ticks between two back-to-back
+ * get_tsc_serial calls, i.e. what timing an empty stretch of code reads
+ */
+unsigned long long tsc_serial_ovhd()
+{
+    unsigned long long t0, t1, best = ~0ULL;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+	t0 = get_tsc_serial();
+	t1 = get_tsc_serial();
+	if (t1 - t0 < best)
+	    best = t1 - t0;
+    }
+    return best;
+}
+
 
 
 
@@ -204,6 +271,7 @@ double mhz(int verbose)
 /** Special counters that compensate for timer interrupt overhead */
 
 static double cyc_per_tick = 0.0;
+static int callibrated = 0;  /* cyc_per_tick may stay 0 if no tick was slow */
 
 #define NEVENT 100
 #define THRESHOLD 1000
@@ -243,6 +311,7 @@ static void callibrate(int verbose)
 	    oldt = newt;
 	}
     }
+    callibrated = 1;
     if (verbose)
 	printf("Setting cyc_per_tick to %f\n", cyc_per_tick);
 }
@@ -253,7 +322,7 @@ void start_comp_counter()
 {
     struct tms t;
 
-    if (cyc_per_tick == 0.0)
+    if (!callibrated)
 	callibrate(0);
     times(&t);
     start_tick = t.tms_utime;
@@ -9,6 +9,16 @@ double get_counter();
 /* Measure overhead for counter */
 double ovhd();
 
+/* Serialized time stamp counter read, for timing short code sequences:
+   nothing before it is still running, and nothing after it has started */
+unsigned long long get_tsc_serial();
+
+/* Unserialized time stamp counter read, for the shortest sequences */
+unsigned long long get_tsc();
+
+/* Ticks read by back-to-back get_tsc_serial calls */
+unsigned long long tsc_serial_ovhd();
+
 /* Determine clock rate of processor (using a default sleeptime) */
 double mhz(int verbose);
 
@@ -41,7 +41,9 @@
  * contribution of throughput to the performance index. Once the
  * students surpass the AVG_LIBC_THRUPUT, they get no further benefit
  * to their score.  This deters students from building extremely fast,
- * but extremely stupid malloc packages.
+ * but extremely stupid malloc packages. mdriver -R replaces it with the
+ * throughput of the fastest allocator it measures on the host it runs
+ * on, and -U lifts the cap.
  */
 #define AVG_LIBC_THRUPUT      600E3  /* 600 Kops/sec */
 
@@ -53,13 +55,17 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (4, 8 or 16). 16 matches the x86-64
+ * SysV ABI, which SSE aligned loads and long double rely on. The
+ * allocator in mm.c rounds its block sizes to this value.
  */
-#define ALIGNMENT 8  
+#define ALIGNMENT 16
 
 /* 
  * Maximum heap size in bytes 
  * 64-bit mode requires more space. RBull 26 May 2018
+ * This is only the default: mdriver -H sets another, and a trace whose
+ * suggested heap size is larger gets that much.
  */
 //#define MAX_HEAP (20*(1<<20))  /* 20 MB */
 #define MAX_HEAP (40*(1<<20))  /* 40 MB */
@@ -70,5 +76,34 @@
 #define USE_FCYC   1   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
 #define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_TSC    0   /* rdtscp calibrated to CLOCK_MONOTONIC_RAW (any Linux box) */
+
+/*
+ * Set to 1 (or build with -DMM_PROFILE=1) to have mm.c profile its fit
+ * searches and placements for mm_stats(). At 0 the profiling is not
+ * compiled in at all.
+ */
+#ifndef MM_PROFILE
+#define MM_PROFILE 0
+#endif
+
+/*
+ * Set to 1 (or build with -DMM_PHASES=1) to have mm.c time its fit
+ * search, place, coalesce, extend_heap and realloc copy phases with the
+ * TSC for mm_phases(). At 0 the timers are not compiled in at all.
+ */
+#ifndef MM_PHASES
+#define MM_PHASES 0
+#endif
+
+/*
+ * Set to 1 (or build with -DMM_CACHESIM=1) to have mm.c report every
+ * header, footer and free-list link it reads or writes, and the payload
+ * bytes it copies or zeroes, to the simulated caches of cachesim.c. At 0
+ * the hooks are not compiled in at all.
+ */
+#ifndef MM_CACHESIM
+#define MM_CACHESIM 0
+#endif
 
 #endif /* __CONFIG_H */
@@ -6,6 +6,7 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "tsc.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
@@ -30,12 +31,27 @@ void init_fsecs(void)
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
+
+    /* Calibrate the compensating counter now rather than in the first
+       timing, so that processes forked from here share the result */
+    start_comp_counter();
+    get_comp_counter();
 #elif USE_ITIMER
     if (verbose)
 	printf("Measuring performance with the interval timer.\n");
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_TSC
+    tsc_init();
+    if (verbose)
+	printf("Measuring performance with the time stamp counter: "
+	       "%.1f MHz, %sinvariant, %llu ticks (%.1f ns) per read.\n",
+	       tsc_hz() / 1e6, tsc_invariant() ? "" : "not ", tsc_overhead(),
+	       tsc_overhead() * 1e9 / tsc_hz());
+    if (!tsc_invariant())
+	printf("Warning: the TSC rate changes with the CPU clock, so times "
+	       "will vary with frequency scaling.\n");
 #endif
 }
 
@@ -51,7 +67,25 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_TSC
+    return ftimer_tsc(f, argp, 11);
 #endif 
 }
 
 
+
+/*
+ * fsecs_timer - Return the name of the timer fsecs uses, for reports
+ */
+char *fsecs_timer(void)
+{
+#if USE_FCYC
+    return "fcyc";
+#elif USE_ITIMER
+    return "itimer";
+#elif USE_GETTOD
+    return "gettod";
+#elif USE_TSC
+    return "tsc";
+#endif
+}
@@ -0,0 +1,95 @@
+/*
+ * hist.c - Log-bucketed latency histograms in the style of HdrHistogram
+ *
+ * A value v below 2^(HIST_SUB_BITS+1) has a bucket of its own. Above
+ * that, with e = msb(v) - HIST_SUB_BITS, v lands in bucket
+ * HIST_SUB*e + (v >> e), whose values all share v's top HIST_SUB_BITS+1
+ * bits.
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * bucket_of - Index of the bucket that counts val
+ */
+static int bucket_of(unsigned long long val)
+{
+    int e;
+
+    if (val < 2 * HIST_SUB)
+	return (int)val;
+    e = 63 - __builtin_clzll(val) - HIST_SUB_BITS;
+    return HIST_SUB * e + (int)(val >> e);
+}
+
+/*
+ * bucket_top - Largest value counted by bucket i
+ */
+static unsigned long long bucket_top(int i)
+{
+    int e;
+
+    if (i < 2 * HIST_SUB)
+	return i;
+    e = i / HIST_SUB - 1;
+    return (((unsigned long long)(i - HIST_SUB * e) + 1) << e) - 1;
+}
+
+/*
+ * hist_init - Empty the histogram
+ */
+void hist_init(hist_t *h)
+{
+    memset(h, 0, sizeof(hist_t));
+}
+
+/*
+ * hist_record - Count one value
+ */
+void hist_record(hist_t *h, unsigned long long val)
+{
+    h->counts[bucket_of(val)]++;
+    h->total++;
+    if (val > h->max)
+	h->max = val;
+}
+
+/*
+ * hist_merge - Add the counts of src into dst
+ */
+void hist_merge(hist_t *dst, hist_t *src)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+	dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    if (src->max > dst->max)
+	dst->max = src->max;
+}
+
+/*
+ * hist_percentile - Value at percentile pct, reported as the top of the
+ *     bucket holding it but never more than the largest value seen
+ */
+unsigned long long hist_percentile(hist_t *h, double pct)
+{
+    unsigned long long rank, seen = 0;
+    unsigned long long top;
+    int i;
+
+    if (h->total == 0)
+	return 0;
+    rank = (unsigned long long)(pct / 100.0 * h->total + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank) {
+	    top = bucket_top(i);
+	    return (top < h->max) ? top : h->max;
+	}
+    }
+    return h->max;
+}
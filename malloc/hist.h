@@ -0,0 +1,30 @@
+/*
+ * hist.h - Log-bucketed latency histograms in the style of HdrHistogram
+ *
+ * Values are counted in buckets that are exact below 2^(HIST_SUB_BITS+1)
+ * and cover 1/2^HIST_SUB_BITS of a power of two above that, so any
+ * percentile is reported to within about 3% of the true value.
+ */
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)   /* sub-buckets per power of 2 */
+#define HIST_BUCKETS  (64 * HIST_SUB)
+
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;  /* number of values recorded */
+    unsigned long long max;    /* largest value recorded */
+} hist_t;
+
+/* Empty the histogram */
+void hist_init(hist_t *h);
+
+/* Count one value */
+void hist_record(hist_t *h, unsigned long long val);
+
+/* Add the counts of src into dst */
+void hist_merge(hist_t *dst, hist_t *src);
+
+/* Smallest value that at least pct percent of the values are at or below
+   (to within a bucket); the largest value for pct = 100 */
+unsigned long long hist_percentile(hist_t *h, double pct);
@@ -7,18 +7,38 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <dlfcn.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "hist.h"
+#include "trace.h"
+#include "stream.h"
+#include "pcbench.h"
+#include "perfctr.h"
+#include "bench.h"
+#include "cachesim.h"
 #include "config.h"
 
 /**********************
@@ -30,38 +50,77 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
-/* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
+/* Returns true if p is align-byte aligned */
+#define IS_ALIGNED(p, align)  ((((unsigned long)(p)) % (align)) == 0)
+
+/* Payloads up to FILL_MAX bytes are filled and checked in full. Larger
+   ones, which only the multi-GB blocks of large.rep reach, are filled
+   and checked, and written and swept by -w, in their first and last
+   FILL_SPAN bytes alone. */
+#define FILL_MAX   (1UL << 28)
+#define FILL_SPAN  (1 << 16)
+#define RESULTS_MAGIC "# mdriver results 1"  /* first line of a results file */
+#define REGRESS_ALPHA 0.05    /* a slowdown must be this unlikely by chance */
+#define FORMAT_TEXT 0         /* report formats (--format) */
+#define FORMAT_JSON 1
+#define FORMAT_CSV  2
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a treap node keyed by lo */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned int prio;     /* random heap priority that keeps the tree balanced */
+    struct range_t *left;  /* ranges below lo (also the pool's free link) */
+    struct range_t *right; /* ranges above lo */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+/* Range records are carved from chunks of this many at a time */
+#define RANGE_CHUNK 4096
 
 /* Holds the information for one trace file*/
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
+    size_t sugg_heapsize;/* suggested heap size (a floor for the mm heap) */
+    long num_ids;        /* number of alloc/realloc ids */
+    long num_ops;        /* number of distinct requests */
+    long num_objs;       /* number of blocks touched by those requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace (ops point into it) */
+    size_t map_len;      /* length of that mapping, 0 for text traces */
 } trace_t;
 
+/*
+ * Header of a binary trace file. It is followed directly by num_ops
+ * packed traceop_t records, which the driver replays in place from a
+ * read-only mapping. The records are in the byte order and layout of
+ * the machine that wrote them; order and opsize catch a mismatch.
+ * Replaying in place needs the records as the replay reads them, so
+ * they are not packed any tighter: a binary trace is several times the
+ * size of its text, and stream traces (-Z) are the compact format.
+ */
+#define BTRACE_MAGIC   "MMTRACE"      /* 8 bytes with the NUL */
+#define BTRACE_VERSION 3
+#define BTRACE_ORDER   0x01020304
+typedef struct {
+    char magic[8];       /* BTRACE_MAGIC */
+    int version;         /* BTRACE_VERSION */
+    int order;           /* BTRACE_ORDER as written by the host */
+    int opsize;          /* sizeof(traceop_t) on the host */
+    int weight;          /* the fields of the text header... */
+    size_t sugg_heapsize;
+    long num_ids;
+    long num_ops;
+    long num_objs;       /* ... and the block count read_trace computes */
+} btrace_hdr_t;
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -70,21 +129,130 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    long *order;     /* ids of the live blocks, for the touch replays (-w) */
+    char *listed;    /* ... and whether each id is on that list */
+    struct ref_t *ref;  /* allocator of a calibration replay (-R) */
 } speed_t;
 
+/* An allocator the throughput is scored against (-R): libc's, or one
+   loaded from a shared library whose functions may have a prefix */
+typedef struct ref_t {
+    char name[MAXLINE];
+    void *(*malloc)(size_t);
+    void (*free)(void *);
+    void *(*realloc)(void *, size_t);
+    void *(*calloc)(size_t, size_t);
+    int (*memalign)(void **, size_t, size_t);
+    double ops, secs;     /* totals over the traces it replayed */
+    double *kops;         /* throughput on each trace, 0 if skipped */
+} ref_t;
+
+/* The throughput of one thread count in a threaded replay (-j) */
+typedef struct {
+    double secs;     /* wall time until the last thread was done */
+    double serial;   /* wall time of the same parts one after another */
+    double *kops;    /* throughput of each thread, NULL if not run */
+} scale_t;
+
+/* What each thread of a threaded replay is given and hands back */
+typedef struct {
+    trace_t part;             /* this thread's share of the requests */
+    int tracenum;             /* trace number for error messages */
+    int libc;                 /* replay on libc malloc instead of mm */
+    int check;                /* check the requests rather than time them */
+    int valid;                /* did the check pass? */
+    double begin, end;        /* wall clock when it started and was done */
+    pthread_barrier_t *start; /* holds every thread until all are ready */
+} worker_t;
+
+/* Summary of a trace's fragmentation timeline (-m). Each sample stands
+   for the ops since the one before, so the averages are over ops. */
+typedef struct {
+    long samples;    /* samples taken, 0 if none */
+    double twutil;   /* live payload over heap size, averaged over ops */
+    double ext_avg;  /* external fragmentation, 1 - largest free/free */
+    double ext_max;
+    double int_avg;  /* internal fragmentation: the share of allocated
+			bytes that are headers and padding, not payload */
+} timeline_t;
+
+/* A trace replayed with its payloads written and swept (-w) */
+typedef struct {
+    long sweeps;     /* sweeps over the live blocks in one replay */
+    double secs;     /* time of the replay, as fsecs measures it */
+    perfctr_t ctrs;  /* hardware counts of one more replay */
+} touch_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    int stream;      /* was it replayed as a stream trace? */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* defined only in latency mode (-L) */
+    hist_t *lat;     /* per-request latencies in cycles, one per type */
+
+    /* defined only in threaded mode (-j) */
+    scale_t *scale;  /* scale[n-1] is the replay in n threads */
+
+    /* defined only in counter mode (-P) */
+    perfctr_t ctrs;  /* hardware counts of one timed replay */
+
+    /* defined only in runner mode (-r) */
+    bench_t runs;    /* Kops of each repeated replay, summarized */
+
+    /* defined only in touch mode (-w) */
+    touch_t touch;   /* the replay that uses the blocks it allocates */
+
+    /* defined only in timeline mode (-m), for the student malloc package */
+    timeline_t tl;   /* fragmentation over the course of the trace */
+
+    /* defined only for the student malloc package built with MM_PROFILE */
+    mm_prof_t prof;  /* fit searches of the util replay */
+
+    /* defined only for the student malloc package built with MM_PHASES */
+    mm_phases_t phases;  /* ticks in each phase of one timed replay */
+    unsigned long long phase_ticks;  /* ... and in the whole replay */
+
+    /* defined only for the student malloc package built with MM_CACHESIM */
+    cachesim_counts_t sim;  /* simulated misses of one replay */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* The totals the performance index is computed from */
+typedef struct {
+    double util;       /* average util over the traces */
+    double ops, secs;  /* total ops and secs of the valid traces */
+    double p1, p2;     /* util and throughput shares of the index */
+    double perfindex;
+    int numcorrect;    /* number of valid traces */
+    int regressions;   /* traces worse than the baseline (-c) */
+} summary_t;
+
+/* The machine the run is on, for reports */
+typedef struct {
+    struct utsname uts;
+    char cpu[MAXLINE];   /* CPU model name */
+    long cpus;           /* CPUs online */
+    char *governor;      /* cpufreq governor, NULL if unknown */
+    char time[32];       /* when the run finished, in UTC */
+} host_t;
+
+/* A trace's stats as a results file (-s) recorded them */
+typedef struct {
+    char name[MAXLINE];
+    int valid;
+    double util, ops, secs;
+    bench_t runs;
+    cachesim_counts_t sim;  /* simulated misses, all 0 if none were saved */
+} baseline_t;
+
 /********************
  * Global variables
  *******************/
@@ -95,6 +263,63 @@ char msg[MAXLINE];      /* for whenever we need to compose an error message */
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Names of the request types, for reports */
+static char *reqnames[NREQTYPES] = {
+    "malloc", "free", "realloc", "malloc_batch", "free_batch",
+    "free_sized", "memalign", "calloc"
+};
+
+/* Cycles a serialized TSC read adds to every latency sample (-L) */
+static unsigned long long tsc_ovhd = 0;
+
+/* If set, measure per-request latencies (-L) */
+static int latency = 0;
+
+/* Most threads the trace is replayed in (-j), 0 for none */
+static int nthreads = 0;
+
+/* If set, count hardware events around one timed replay (-P) */
+static int counters = 0;
+
+/* Timed replays of each trace for the benchmark runner (-r), 0 for none */
+static int reps = 0;
+
+/* Worker processes that evaluate traces side by side (-p), 0 for none */
+static int nprocs = 0;
+
+/* Ops between the samples of a fragmentation timeline (-m), 0 for
+   none, and the file the samples of every trace are appended to */
+static long tl_every = 0;
+static int tl_fd = -1;
+
+/* Ops between the sweeps over the live blocks of a touch replay (-w),
+   0 for none, and whether a sweep visits them in random order rather
+   than the order they were allocated in */
+static long touch_every = 0;
+static int touch_random = 0;
+
+/* The throughput the index counts as full marks: AVG_LIBC_THRUPUT, or
+   the fastest allocator measured on this host (-R), and whether the
+   index gives no more for beating it (uncapped by -U) */
+static double ref_thruput = AVG_LIBC_THRUPUT;
+static char *ref_name = NULL;
+static int thru_cap = 1;
+
+/* Shared libraries -R auto looks for, with the prefix of their malloc */
+static char *ref_auto[][2] = {
+    {"libjemalloc.so.2", ""},
+    {"libtcmalloc_minimal.so.4", ""},
+    {"libtcmalloc.so.4", ""},
+    {"libmimalloc.so.2", "mi_"},
+    {"libtbbmalloc.so.2", "scalable_"},
+    {NULL, NULL}
+};
+
+/* Regressions from the baseline (-c) that fail the run (-T): the most
+   util may drop, in points, and throughput, in percent */
+static double util_slack = 1.0;
+static double thru_slack = 5.0;
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -105,31 +330,137 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum);
+/* these functions manipulate range trees */
+static int add_range(range_t **ranges, char *lo, size_t size, int align,
+		     int tracenum, long opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static void range_flush(void);
+static size_t check_usable(char *p, size_t size, int tracenum, long opnum);
+static void fill_payload(char *p, size_t len, int c);
+static int check_payload(char *p, size_t len, size_t n, int c);
+static int intact(char *p, long index, int tracenum, long opnum);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static void map_trace(trace_t *trace, int fd, char *path);
+static void write_trace(trace_t *trace, char *path);
 static void free_trace(trace_t *trace);
+static void free_stats(stats_t *stats, int n);
+
+/* Run every evaluation of one trace, here or in a worker process */
+static void eval_libc_trace(char *tracefile, int i, stats_t *stats);
+static void eval_mm_trace(char *tracefile, int i, stats_t *stats,
+			  range_t **ranges);
+static void eval_pool(char **tracefiles, int n, stats_t *stats, int libc);
+static void pool_worker(int fd, int slot, char *tracefile, int i, int libc);
+static void pool_collect(int fd, pid_t pid, int i, stats_t *stats);
+static void pin_cpu(int slot);
+static int read_all(int fd, void *buf, size_t len);
+static void write_all(int fd, void *buf, size_t len);
+static void eval_counters(fsecs_test_funct f, void *argp, perfctr_t *pc);
+static void eval_runs(fsecs_test_funct f, void *argp, double ops, bench_t *b);
+#if MM_PHASES
+static void eval_phases(fsecs_test_funct f, void *argp, stats_t *stats);
+#endif
+#if MM_CACHESIM
+static void eval_cachesim(fsecs_test_funct f, void *argp, stats_t *stats);
+#endif
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
 
+/* Routines for calibrating the throughput score on this host (-R) */
+static void calibrate(char *spec, char **tracefiles, int n);
+static int load_ref(char *lib, char *prefix, ref_t *ref);
+static void eval_ref_speed(void *ptr);
+
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
 
+/* The same checks and replays, on requests that arrive in pieces */
+static int valid_ops(trace_t *trace, int tracenum, range_t **ranges,
+		     long base);
+static void util_ops(trace_t *trace, size_t *total_size, 
+		     size_t *max_total_size);
+static void speed_ops(trace_t *trace);
+
+/* Evaluation of a stream trace for either package */
+static void eval_stream(char *path, int tracenum, stats_t *stats,
+			range_t **ranges, int libc);
+
+/* Per-request latency replay for either package */
+static hist_t *eval_latency(trace_t *trace, int libc);
+
+/* Replays that write and read the payloads they allocate (-w) */
+static void eval_touch(trace_t *trace, int libc, touch_t *touch);
+static void eval_mm_touch(void *ptr);
+static void eval_libc_touch(void *ptr);
+static void touch_ops(trace_t *trace, long *order, char *listed, int libc);
+static long touch_sweep(trace_t *trace, long *order, char *listed, long n, 
+			unsigned int *seed);
+
+/* Aging one heap (-k) */
+static int eval_soak(char **tracefiles, int n, long iters, long every);
+static long *live_at_end(trace_t *trace, long *nleft);
+
+/* Fragmentation over time */
+static void eval_timeline(trace_t *trace, int tracenum, char *name,
+			  timeline_t *tl);
+
+/* Replay in several threads at once for either package */
+static int eval_threads(trace_t *trace, int tracenum, int libc,
+			scale_t **scale);
+static trace_t *split_trace(trace_t *trace, int n);
+static void free_parts(trace_t *parts, int n);
+static trace_t *join_parts(trace_t *parts, int n);
+static double run_threads(trace_t *parts, int n, worker_t *w,
+			  int tracenum, int libc, int check);
+static void *replay_thread(void *ptr);
+
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printscaling(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printruns(int n, stats_t *stats);
+static void printtimeline(int n, stats_t *stats);
+static void printtouch(int n, stats_t *stats);
+#if MM_PROFILE
+static void printprofile(int n, stats_t *stats);
+#endif
+#if MM_PHASES
+static void printphases(int n, stats_t *stats);
+#endif
+#if MM_CACHESIM
+static void printcachesim(int n, stats_t *stats);
+#endif
+static void save_results(char *path, char **tracefiles, int n, 
+			 stats_t *stats);
+static baseline_t *read_results(char *path, int *n);
+static void get_host(host_t *host);
+static void printjson(FILE *fp, char **tracefiles, int n, stats_t *stats,
+		      stats_t *libc_stats, summary_t *sum);
+static void printcsv(FILE *fp, char **tracefiles, int n, stats_t *stats,
+		     stats_t *libc_stats, summary_t *sum);
+static void json_string(FILE *fp, char *str);
+static void csv_string(FILE *fp, char *str);
+static void print_ratio(FILE *fp, char *fmt, double x, double y);
+static int compare_results(char *path, char **tracefiles, int n, 
+			   stats_t *stats);
+#if MM_CACHESIM
+static int sim_worse(cachesim_counts_t *base, cachesim_counts_t *now);
+#endif
+static double thread_secs(void);
+static double wall_secs(void);
+static void fit_heap(size_t sugg_heapsize);
 static void usage(void);
 static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
+static void malloc_error(int tracenum, long opnum, char *msg);
 static void app_error(char *msg);
 
 /**************
@@ -145,11 +476,34 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int fresh_heap = 0;  /* If set, each run gets a zero-filled heap (-z) */
+    char *binfile = NULL;/* If set, convert the -f trace to this file (-b) */
+    char *zfile = NULL;  /* If set, convert it to this stream trace (-Z) */
+    size_t heap_max = 0; /* If set, the most bytes the mm heap may use (-H) */
+    char *end;
+    stream_info_t info;  /* header of a stream trace being written */
+    char *pcspec = NULL; /* If set, run the producer/consumer benchmark (-q) */
+    pc_config_t pc;      /* ... with this many threads and messages */
+    pc_result_t pcres;
+    char *savefile = NULL;  /* If set, save the mm results here (-s) */
+    char *basefile = NULL;  /* If set, compare them to these (-c) */
+    int regressions = 0;    /* traces worse than the baseline allows */
+    char *tl_path = "timeline.csv";  /* where -m writes its samples */
+    long soak_iters = 0;    /* If set, soak one heap this many times (-k) */
+    long soak_every = 0;    /* ... reporting after every this many */
+    int format = FORMAT_TEXT;  /* report format (--format) */
+    char *simspec = NULL;   /* simulated cache hierarchy (-C) */
+    char *refspec = NULL;   /* If set, calibrate against these (-R) */
+    FILE *report = NULL;    /* where a json or csv report goes */
+    summary_t sum;
+    static struct option longopts[] = {
+        {"format", required_argument, NULL, 'F'},
+        {NULL, 0, NULL, 0}
+    };
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,8 +512,21 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:b:Z:H:j:p:q:r:s:c:T:m:k:w:C:R:hvVgalzLPU",
+                            longopts, NULL)) != EOF) {
         switch (c) {
+        case 'F': /* --format: text, json or csv report */
+            if (!strcmp(optarg, "json"))
+                format = FORMAT_JSON;
+            else if (!strcmp(optarg, "csv"))
+                format = FORMAT_CSV;
+            else if (!strcmp(optarg, "text"))
+                format = FORMAT_TEXT;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
 	    break;
@@ -178,12 +545,121 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'b': /* Convert the trace to binary form and exit */
+            binfile = strdup(optarg);
+            break;
+        case 'Z': /* Convert the trace to a stream trace and exit */
+            zfile = strdup(optarg);
+            break;
+        case 'H': /* Heap size, with an optional K, M or G suffix */
+            heap_max = strtoull(optarg, &end, 0);
+            switch (*end) {
+            case 'G': case 'g': heap_max <<= 10; /* fall through */
+            case 'M': case 'm': heap_max <<= 10; /* fall through */
+            case 'K': case 'k': heap_max <<= 10; end++; break;
+            }
+            if (heap_max == 0 || *end != '\0') {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'j': /* Also replay each trace in 1 to N threads */
+            nthreads = atoi(optarg);
+            if (nthreads < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'p': /* Evaluate traces in this many worker processes */
+            nprocs = atoi(optarg);
+            if (nprocs < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'r': /* Benchmark runner: time this many replays of each trace */
+            reps = atoi(optarg);
+            if (reps < 1 || reps > BENCH_MAX_RUNS) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 's': /* Save the per-trace results to a file */
+            savefile = strdup(optarg);
+            break;
+        case 'c': /* Compare the results to a saved baseline */
+            basefile = strdup(optarg);
+            break;
+        case 'T': /* Regression thresholds: util points[:throughput %] */
+            if (sscanf(optarg, "%lf:%lf", &util_slack, &thru_slack) < 1 ||
+                util_slack < 0 || thru_slack < 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'm': /* Fragmentation timeline: sample every N ops[:file] */
+            tl_every = strtol(optarg, &end, 0);
+            if (*end == ':' && end[1] != '\0')
+                tl_path = end + 1;
+            else if (*end != '\0')
+                tl_every = 0;
+            if (tl_every < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'w': /* Touch replay: sweep the live blocks every N ops[:r] */
+            touch_every = strtol(optarg, &end, 0);
+            if (!strcmp(end, ":r"))
+                touch_random = 1;
+            else if (*end != '\0')
+                touch_every = 0;
+            if (touch_every < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'R': /* Calibrate throughput against these allocators */
+            refspec = optarg;
+            break;
+        case 'U': /* No cap on the throughput share of the index */
+            thru_cap = 0;
+            break;
+        case 'C': /* Simulated caches: size:ways,size:ways,size:ways */
+            simspec = optarg;
+            break;
+        case 'k': /* Soak: replay the traces N times on one heap[:every] */
+            if (sscanf(optarg, "%ld:%ld", &soak_iters, &soak_every) < 1 ||
+                soak_iters < 1 || soak_every < 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'q': /* Producer/consumer benchmark instead of the traces */
+            pcspec = optarg;
+            pc.msgs = 100000;
+            if (sscanf(pcspec, "%d:%d:%ld", &pc.producers, &pc.consumers,
+                       &pc.msgs) < 2 || pc.producers < 1 ||
+                pc.consumers < 1 || pc.msgs < 1) {
+                usage();
+                exit(1);
+            }
+            break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Per-request latency histograms */
+            latency = 1;
+            break;
+        case 'P': /* Hardware counters for each trace */
+            counters = 1;
+            break;
+        case 'z': /* Zero-filled heap for every run, as in a new process */
+            fresh_heap = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -199,6 +675,45 @@ int main(int argc, char **argv)
         }
     }
 	
+    /* Threaded replays keep their results in memory a worker
+       process has no way to hand back */
+    if (nprocs > 0 && nthreads > 0) {
+	fprintf(stderr, "ERROR: -j and -p cannot be used together\n");
+	exit(1);
+    }
+
+    /* A json or csv report has stdout to itself, and everything else
+       the driver prints goes to stderr */
+    if (format != FORMAT_TEXT) {
+	if ((report = fdopen(dup(STDOUT_FILENO), "w")) == NULL)
+	    unix_error("Could not open the report stream");
+	fflush(stdout);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    /*
+     * Convert a trace to binary or stream form, without running anything
+     */
+    if (binfile != NULL || zfile != NULL) {
+	if (num_tracefiles != 1) {
+	    fprintf(stderr, "ERROR: -b and -Z need one trace file given with -f\n");
+	    exit(1);
+	}
+	trace = read_trace(tracedir, tracefiles[0]);
+	if (binfile != NULL)
+	    write_trace(trace, binfile);
+	if (zfile != NULL) {
+	    info.sugg_heapsize = trace->sugg_heapsize;
+	    info.num_ids = trace->num_ids;
+	    info.weight = trace->weight;
+	    info.num_ops = trace->num_ops;
+	    info.num_objs = trace->num_objs;
+	    stream_write(zfile, &info, trace->ops, trace->num_ops);
+	}
+	free_trace(trace);
+	exit(0);
+    }
+
     /* 
      * Check and print team info 
      */
@@ -229,7 +744,7 @@ int main(int argc, char **argv)
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
      */
-    if (tracefiles == NULL) {
+    if (tracefiles == NULL && pcspec == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
 	printf("Using default tracefiles in %s\n", tracedir);
@@ -237,6 +752,95 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    if (latency || pcspec != NULL) {
+	tsc_ovhd = tsc_serial_ovhd();
+	if (verbose)
+	    printf("Timer overhead of %llu cycles subtracted from latencies.\n",
+		   tsc_ovhd);
+    }
+
+    /* 
+     * The repeated runs of each trace stay on one CPU (eval_runs pins
+     * them, and worker processes pin themselves), and a governor that
+     * changes the clock speed under load is the first thing to suspect
+     * when they vary. Any of the CPUs this process may use can be the
+     * one, since the pool's workers spread over all of them.
+     */
+    if (reps > 0) {
+	char *gov;
+	int cpu;
+
+	if ((cpu = bench_slow_cpu(&gov)) >= 0)
+	    printf("Warning: CPU %d uses the \"%s\" cpufreq governor, not "
+		   "\"performance\"; its clock may change between runs.\n",
+		   cpu, gov);
+    }
+
+    /* Set up the simulated caches the mm package reports to */
+#if MM_CACHESIM
+    if (cachesim_config(simspec) < 0) {
+	fprintf(stderr, "ERROR: bad cache hierarchy for -C: %s\n", simspec);
+	exit(1);
+    }
+    if (verbose)
+	printf("Simulating L1 %s, L2 %s, LLC %s caches.\n", 
+	       cachesim_level(0), cachesim_level(1), cachesim_level(2));
+#else
+    if (simspec != NULL)
+	printf("mm.c was built without MM_CACHESIM, ignoring -C.\n");
+#endif
+
+    /* Find out which hardware counters this machine will give us */
+    if (counters) {
+	char *why = NULL;
+	int opened = perfctr_open(&why);
+
+	if (opened == 0) {
+	    printf("Hardware counters unavailable (%s), ignoring -P.\n", why);
+	    counters = 0;
+	}
+	else if (verbose)
+	    printf("Counting %d of %d hardware events.\n", opened, PERFCTR_N);
+    }
+
+    /*
+     * Run the producer/consumer benchmark in place of the traces,
+     * with libc malloc as the baseline if asked for
+     */
+    if (pcspec != NULL) {
+	pc.tsc_ovhd = tsc_ovhd;
+	printf("Producer/consumer benchmark: %d producers, %d consumers, "
+	       "%ld messages each\n", pc.producers, pc.consumers, pc.msgs);
+	if (run_libc) {
+	    pc.libc = 1;
+	    pc_run(&pc, &pcres);
+	    pc_print("libc malloc", &pcres);
+	}
+	if (heap_max != 0)
+	    mem_set_max_heap(heap_max);
+	mem_init();
+	pc.libc = 0;
+	pc_run(&pc, &pcres);
+	pc_print("mm malloc", &pcres);
+	exit(pcres.valid ? 0 : 1);
+    }
+
+    /*
+     * Soak the mm package in place of the evaluation
+     */
+    if (soak_iters > 0) {
+	if (heap_max != 0)
+	    mem_set_max_heap(heap_max);
+	mem_init();
+	exit(eval_soak(tracefiles, num_tracefiles, soak_iters, soak_every) ?
+	     0 : 1);
+    }
+
+    /*
+     * Measure the allocators the throughput is scored against
+     */
+    if (refspec != NULL)
+	calibrate(refspec, tracefiles, num_tracefiles);
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -250,21 +854,13 @@ int main(int argc, char **argv)
 	if (libc_stats == NULL)
 	    unix_error("libc_stats calloc in main failed");
 	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	/* Evaluate the libc malloc package using the K-best scheme,
+	   in a pool of processes if asked to */
+	if (nprocs > 0)
+	    eval_pool(tracefiles, num_tracefiles, libc_stats, 1);
+	else
+	    for (i=0; i < num_tracefiles; i++)
+		eval_libc_trace(tracefiles[i], i, &libc_stats[i]);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
@@ -284,27 +880,32 @@ int main(int argc, char **argv)
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
     
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init(); 
+    /* Initialize the simulated memory system in memlib.c, here or in
+       each worker process */
+    if (heap_max != 0)
+	mem_set_max_heap(heap_max);
+    mem_set_fresh(fresh_heap);
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+    /* Every trace appends its timeline samples to one file, in a
+       single write so that worker processes do not mix them */
+    if (tl_every > 0) {
+	if ((tl_fd = open(tl_path, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 
+			  0644)) < 0) {
+	    sprintf(msg, "Could not open %s", tl_path);
+	    unix_error(msg);
 	}
-	free_trace(trace);
+	sprintf(msg, "trace,name,op,live,heap,free,largest_free,"
+		"free_blocks,internal,ext_frag,util\n");
+	write_all(tl_fd, msg, strlen(msg));
+    }
+
+    /* Evaluate student's mm malloc package using the K-best scheme */
+    if (nprocs > 0)
+	eval_pool(tracefiles, num_tracefiles, mm_stats, 0);
+    else {
+	mem_init(); 
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &mm_stats[i], &ranges);
     }
 
     /* Display the mm results in a compact table */
@@ -315,15 +916,19 @@ int main(int argc, char **argv)
     }
 
     /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+     * Accumulate the aggregate statistics for the student's mm package.
+     * The calibration of -R leaves stream traces out, so the throughput
+     * it is scored against does too.
      */
     secs = 0;
     ops = 0;
     util = 0;
     numcorrect = 0;
     for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
+	if (ref_name == NULL || !mm_stats[i].stream) {
+	    secs += mm_stats[i].secs;
+	    ops += mm_stats[i].ops;
+	}
 	util += mm_stats[i].util;
 	if (mm_stats[i].valid)
 	    numcorrect++;
@@ -337,15 +942,21 @@ int main(int argc, char **argv)
 	avg_mm_throughput = ops/secs;
 
 	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+	if (avg_mm_throughput > ref_thruput && thru_cap) {
 	    p2 = (double)(1.0 - UTIL_WEIGHT);
 	} 
 	else {
 	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+		(avg_mm_throughput/ref_thruput);
 	}
 	
 	perfindex = (p1 + p2)*100.0;
+	if (ref_name != NULL || !thru_cap)
+	    printf("Throughput %.0f Kops against %s at %.0f Kops (%.2fx), "
+		   "%s\n", avg_mm_throughput/1e3, 
+		   ref_name ? ref_name : "AVG_LIBC_THRUPUT", ref_thruput/1e3,
+		   avg_mm_throughput/ref_thruput, 
+		   thru_cap ? "capped at 1x" : "uncapped");
 	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
 	       p1*100, 
 	       p2*100, 
@@ -353,6 +964,7 @@ int main(int argc, char **argv)
 	
     }
     else { /* There were errors */
+	p1 = p2 = 0.0;
 	perfindex = 0.0;
 	printf("Terminated with %d errors\n", errors);
     }
@@ -362,35 +974,213 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
+    /*
+     * Check the results against a baseline, then save them as one
+     */
+    if (basefile != NULL)
+	regressions = compare_results(basefile, tracefiles, num_tracefiles, 
+				      mm_stats);
+    if (savefile != NULL)
+	save_results(savefile, tracefiles, num_tracefiles, mm_stats);
+
+    /*
+     * Write the machine-readable report
+     */
+    if (report != NULL) {
+	sum.util = avg_mm_util;
+	sum.ops = ops;
+	sum.secs = secs;
+	sum.p1 = p1;
+	sum.p2 = p2;
+	sum.perfindex = perfindex;
+	sum.numcorrect = numcorrect;
+	sum.regressions = regressions;
+	if (format == FORMAT_JSON)
+	    printjson(report, tracefiles, num_tracefiles, mm_stats, 
+		      libc_stats, &sum);
+	else
+	    printcsv(report, tracefiles, num_tracefiles, mm_stats, 
+		     libc_stats, &sum);
+	fclose(report);
+    }
+    free_stats(mm_stats, num_tracefiles);
+    free_stats(libc_stats, num_tracefiles);
+    if (regressions > 0) {
+	printf("Regressed from the baseline on %d trace%s\n", regressions,
+	       (regressions == 1) ? "" : "s");
+	exit(2);
+    }
+
     exit(0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is a
+ * treap ordered by lo, so each check, insert and delete takes
+ * O(log n) expected time. The records come from a pool, not from
+ * one malloc call apiece.
  ****************************************************************/
 
+static __thread range_t *range_pool = NULL;  /* this thread's free records */
+static range_t *range_spare = NULL;  /* records left by finished threads */
+static pthread_mutex_t range_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * range_alloc - Take a range record from the pool, refilling the pool
+ *     with another RANGE_CHUNK records when it runs dry
+ */
+static range_t *range_alloc(void)
+{
+    range_t *p;
+    int i;
+
+    if (range_pool == NULL) {
+	pthread_mutex_lock(&range_lock);
+	range_pool = range_spare;
+	range_spare = NULL;
+	pthread_mutex_unlock(&range_lock);
+    }
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in range_alloc");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].left = range_pool;
+	    range_pool = &p[i];
+	}
+    }
+    p = range_pool;
+    range_pool = p->left;
+    return p;
+}
+
+/*
+ * range_release - Return a range record to the pool
+ */
+static void range_release(range_t *p)
+{
+    p->left = range_pool;
+    range_pool = p;
+}
+
+/*
+ * range_flush - Hand this thread's pool to the shared spares before the
+ *     thread exits, for the next thread that runs dry to take
+ */
+static void range_flush(void)
+{
+    range_t *p;
+
+    if ((p = range_pool) == NULL)
+	return;
+    while (p->left != NULL)
+	p = p->left;
+    pthread_mutex_lock(&range_lock);
+    p->left = range_spare;
+    range_spare = range_pool;
+    pthread_mutex_unlock(&range_lock);
+    range_pool = NULL;
+}
+
+/*
+ * range_prio - Next treap priority from a fixed-seed xorshift generator,
+ *     so every run builds the same trees. Each thread has its own.
+ */
+static unsigned int range_prio(void)
+{
+    static __thread unsigned int x = 2463534242u;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/*
+ * range_insert - Insert node n into the treap rooted at *root, rotating
+ *     it up past any parents with a lower priority
+ */
+static void range_insert(range_t **root, range_t *n)
+{
+    range_t *t = *root;
+
+    if (t == NULL) {
+	*root = n;
+	return;
+    }
+    if (n->lo < t->lo) {
+	range_insert(&t->left, n);
+	if (t->left->prio > t->prio) {   /* rotate right */
+	    *root = t->left;
+	    t->left = (*root)->right;
+	    (*root)->right = t;
+	}
+    }
+    else {
+	range_insert(&t->right, n);
+	if (t->right->prio > t->prio) {  /* rotate left */
+	    *root = t->right;
+	    t->right = (*root)->left;
+	    (*root)->left = t;
+	}
+    }
+}
+
+/*
+ * range_delete - Unlink the node at *root by rotating it down until it
+ *     has at most one child, then splicing that child into its place
+ */
+static void range_delete(range_t **root)
+{
+    range_t *t = *root;
+    range_t *c;
+
+    if (t->left == NULL) {
+	*root = t->right;
+	return;
+    }
+    if (t->right == NULL) {
+	*root = t->left;
+	return;
+    }
+    if (t->left->prio > t->right->prio) {  /* rotate right */
+	c = t->left;
+	t->left = c->right;
+	c->right = t;
+	*root = c;
+	range_delete(&c->right);
+    }
+    else {                                 /* rotate left */
+	c = t->right;
+	t->right = c->left;
+	c->left = t;
+	*root = c;
+	range_delete(&c->left);
+    }
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     size bytes at addr lo, which must be aligned to align bytes. After
+ *     checking the block for correctness, we create a range struct for
+ *     this block and add it to the range tree. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+static int add_range(range_t **ranges, char *lo, size_t size, int align,
+		     int tracenum, long opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *pred = NULL, *succ = NULL;
     char msg[MAXLINE];
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be align-byte aligned */
+    if (!IS_ALIGNED(lo, align)) {
 	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
-		lo, ALIGNMENT);
+		lo, align);
         malloc_error(tracenum, opnum, msg);
         return 0;
     }
@@ -404,27 +1194,44 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. The recorded
+     * payloads are disjoint, so only the ones starting just at or
+     * below lo and just above it can overlap this one.
+     */
+    for (p = *ranges;  p != NULL; ) {
+	if (p->lo <= lo) {
+	    pred = p;
+	    p = p->right;
+	}
+	else {
+	    succ = p;
+	    p = p->left;
+	}
+    }
+    if (pred != NULL && pred->hi >= lo)
+	p = pred;
+    else if (succ != NULL && succ->lo <= hi)
+	p = succ;
+    else
+	p = NULL;
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = range_alloc();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->prio = range_prio();
+    p->left = p->right = NULL;
+    range_insert(ranges, p);
     return 1;
 }
 
@@ -436,17 +1243,13 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
-    // int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            // size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    range_t **pp = ranges;
+
+    while ((p = *pp) != NULL && p->lo != lo)
+	pp = (lo < p->lo) ? &p->left : &p->right;
+    if (p != NULL) {
+	range_delete(pp);
+	range_release(p);
     }
 }
 
@@ -455,23 +1258,94 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    range_release(p);
     *ranges = NULL;
 }
 
+/*
+ * check_usable - Ask the mm package how much of the block at p may be
+ *     used. It must cover the size bytes requested. Returns the usable
+ *     size, or 0 after reporting an error.
+ */
+static size_t check_usable(char *p, size_t size, int tracenum, long opnum)
+{
+    size_t usable = mm_usable_size(p);
+    char msg[MAXLINE];
+
+    if (usable < size) {
+	sprintf(msg, "mm_usable_size (%zu) of payload %p is less than the "
+		"%zu bytes requested", usable, p, size);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+    return usable;
+}
+
+/*
+ * fill_payload - Fill the len bytes at p with c. Only the first and
+ *     last FILL_SPAN bytes of a block over FILL_MAX are filled, so that
+ *     a huge block is checked without paging all of it in.
+ */
+static void fill_payload(char *p, size_t len, int c)
+{
+    if (len <= FILL_MAX)
+	memset(p, c, len);
+    else {
+	memset(p, c, FILL_SPAN);
+	memset(p + len - FILL_SPAN, c, FILL_SPAN);
+    }
+}
+
+/*
+ * check_payload - Do the first n bytes at p still hold c wherever
+ *     fill_payload(p, len, c) wrote it?
+ */
+static int check_payload(char *p, size_t len, size_t n, int c)
+{
+    size_t j;
+
+    for (j = 0; j < n; j++) {
+	if (len > FILL_MAX && j == FILL_SPAN)
+	    j = len - FILL_SPAN;    /* skip the unfilled middle */
+	if (j >= n)
+	    break;
+	if (p[j] != (char)c)
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * intact - Does the block at p, about to be freed, still hold the low
+ *     byte of its id everywhere valid_ops filled it? Another block laid
+ *     over it, by another thread too, would have overwritten some.
+ */
+static int intact(char *p, long index, int tracenum, long opnum)
+{
+    size_t usable = mm_usable_size(p);
+    char msg[MAXLINE];
+
+    if (!check_payload(p, usable, usable, index & 0xFF)) {
+	sprintf(msg, "Payload %p was overwritten while it was allocated", p);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+    return 1;
+}
 
 /**********************************************
  * The following routines manipulate tracefiles
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. A binary
+ *     trace, recognized by its magic number, is mapped rather than read.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
@@ -479,9 +1353,10 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    unsigned long index, size, count;
+    unsigned long max_index = 0;
+    unsigned long op_index;
+    char magic[sizeof(BTRACE_MAGIC)];
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -497,7 +1372,16 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }    
-    if (fscanf(tracefile, "%d %d %d %d",
+    trace->map = NULL;
+    trace->map_len = 0;
+    if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic) &&
+	memcmp(magic, BTRACE_MAGIC, sizeof(magic)) == 0) {
+	map_trace(trace, fileno(tracefile), path);
+	fclose(tracefile);
+	return trace;
+    }
+    rewind(tracefile);
+    if (fscanf(tracefile, "%zu %ld %ld %d",
 	   &(trace->sugg_heapsize),  /* not used */
 	   &(trace->num_ids),     
 	   &(trace->num_ops),
@@ -525,10 +1409,11 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
+    trace->num_objs = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
       switch(type[0]) {
       case 'a':
-	if (fscanf(tracefile, "%u %u", &index, &size) != 2) {
+	if (fscanf(tracefile, "%lu %lu", &index, &size) != 2) {
 	  printf("Read failure in tracefile %s\n", path);
 	  exit(1);
 	}
@@ -538,7 +1423,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	max_index = (index > max_index) ? index : max_index;
 	break;
       case 'r':
-	if (fscanf(tracefile, "%u %u", &index, &size) != 2) {
+	if (fscanf(tracefile, "%lu %lu", &index, &size) != 2) {
 	  printf("Read failure in tracefile %s\n", path);
 	  exit(1);
 	}
@@ -548,59 +1433,595 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	max_index = (index > max_index) ? index : max_index;
 	break;
       case 'f':
-	if (fscanf(tracefile, "%ud", &index) != 1) {
+	if (fscanf(tracefile, "%lu", &index) != 1) {
 	  printf("Read failure in tracefile %s\n", path);
 	  exit(1);
 	}
 	trace->ops[op_index].type = FREE;
 	trace->ops[op_index].index = index;
 	break;
-      default:
-	printf("Bogus type character (%c) in tracefile %s\n", 
-	       type[0], path);
-	exit(1);
-      }
-      op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
+      case 'c':
+	if (fscanf(tracefile, "%lu %lu", &index, &size) != 2) {
+	  printf("Read failure in tracefile %s\n", path);
+	  exit(1);
+	}
+	trace->ops[op_index].type = CALLOC;
+	trace->ops[op_index].index = index;
+	trace->ops[op_index].size = size;
+	max_index = (index > max_index) ? index : max_index;
+	break;
+      case 'm':
+	if (fscanf(tracefile, "%lu %lu %lu", &index, &count, &size) != 3) {
+	  printf("Read failure in tracefile %s\n", path);
+	  exit(1);
+	}
+	trace->ops[op_index].type = MEMALIGN;
+	trace->ops[op_index].index = index;
+	trace->ops[op_index].align = count;
+	trace->ops[op_index].size = size;
+	max_index = (index > max_index) ? index : max_index;
+	break;
+      case 's':
+	if (fscanf(tracefile, "%lu", &index) != 1) {
+	  printf("Read failure in tracefile %s\n", path);
+	  exit(1);
+	}
+	trace->ops[op_index].type = FREE_SIZED;
+	trace->ops[op_index].index = index;
+	break;
+      case 'A':
+	if (fscanf(tracefile, "%lu %lu %lu", &index, &count, &size) != 3 ||
+	    count == 0) {
+	  printf("Read failure in tracefile %s\n", path);
+	  exit(1);
+	}
+	trace->ops[op_index].type = ALLOC_BATCH;
+	trace->ops[op_index].index = index;
+	trace->ops[op_index].count = count;
+	trace->ops[op_index].size = size;
+	index += count - 1;
+	max_index = (index > max_index) ? index : max_index;
+	trace->num_objs += count - 1;
+	break;
+      case 'F':
+	if (fscanf(tracefile, "%lu %lu", &index, &count) != 2 || count == 0) {
+	  printf("Read failure in tracefile %s\n", path);
+	  exit(1);
+	}
+	trace->ops[op_index].type = FREE_BATCH;
+	trace->ops[op_index].index = index;
+	trace->ops[op_index].count = count;
+	trace->num_objs += count - 1;
+	break;
+      default:
+	printf("Bogus type character (%c) in tracefile %s\n", 
+	       type[0], path);
+	exit(1);
+      }
+      op_index++;
+      trace->num_objs++;
+	
+    }
+    fclose(tracefile);
+    assert(max_index == (unsigned long)trace->num_ids - 1);
+    assert((unsigned long)trace->num_ops == op_index);
+    
+    return trace;
+}
+
+/*
+ * map_trace - Map the binary trace open on fd and point trace->ops at
+ *     the records in the mapping. Only the blocks arrays are allocated.
+ */
+static void map_trace(trace_t *trace, int fd, char *path)
+{
+    struct stat st;
+    btrace_hdr_t *hdr;
+    traceop_t *op;
+    long i, index, last;
+
+    if (fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not stat %s in map_trace", path);
+	unix_error(msg);
+    }
+    if ((size_t)st.st_size < sizeof(btrace_hdr_t)) {
+	printf("Truncated header in binary tracefile %s\n", path);
+	exit(1);
+    }
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in map_trace", path);
+	unix_error(msg);
+    }
+    hdr = (btrace_hdr_t *)trace->map;
+    if (hdr->version != BTRACE_VERSION || hdr->order != BTRACE_ORDER ||
+	hdr->opsize != sizeof(traceop_t) || hdr->num_ops < 0 || 
+	hdr->num_ids < 0 || (size_t)hdr->num_ops > 
+	(trace->map_len - sizeof(btrace_hdr_t)) / sizeof(traceop_t)) {
+	printf("Binary tracefile %s was not written for this driver\n", path);
+	exit(1);
+    }
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->num_objs = hdr->num_objs;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+
+    /* Every id a request names must have a slot in the blocks arrays */
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	index = op->index;
+	last = index;
+	if (op->type == ALLOC_BATCH || op->type == FREE_BATCH)
+	    last += op->count - 1;
+	if (op->type > CALLOC || (op->count < 1 && 
+	    (op->type == ALLOC_BATCH || op->type == FREE_BATCH)) ||
+	    index < 0 || last >= trace->num_ids || last < index) {
+	    printf("Bad request %ld in binary tracefile %s\n", i, path);
+	    exit(1);
+	}
+    }
+
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in map_trace");
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in map_trace");
+}
+
+/*
+ * write_trace - Write the trace in memory to path as a binary trace
+ */
+static void write_trace(trace_t *trace, char *path)
+{
+    FILE *fp;
+    btrace_hdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BTRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = BTRACE_VERSION;
+    hdr.order = BTRACE_ORDER;
+    hdr.opsize = sizeof(traceop_t);
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+    hdr.num_objs = trace->num_objs;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not create %s in write_trace", path);
+	unix_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, fp) != 
+	(size_t)trace->num_ops || fclose(fp) != 0) {
+	sprintf(msg, "Could not write %s in write_trace", path);
+	unix_error(msg);
+    }
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace(). The
+ *              ops of a binary trace are unmapped instead.
+ */
+void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map_len > 0)   /* free the three arrays... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * free_stats - Free the n stats records, along with the latency
+ *     histograms and threaded replays they point to
+ */
+static void free_stats(stats_t *stats, int n)
+{
+    int i, k;
+
+    if (stats == NULL)
+	return;
+    for (i = 0; i < n; i++) {
+	free(stats[i].lat);
+	if (stats[i].scale == NULL)
+	    continue;
+	for (k = 0; k < nthreads; k++)
+	    free(stats[i].scale[k].kops);
+	free(stats[i].scale);
+    }
+    free(stats);
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * eval_libc_trace - Evaluate libc malloc on trace number i, from
+ *    tracefile, into *stats
+ */
+static void eval_libc_trace(char *tracefile, int i, stats_t *stats)
+{
+    char path[MAXLINE];
+    trace_t *trace;
+    speed_t speed_params;
+
+    perfctr_clear(&stats->ctrs);
+    sprintf(path, "%s%s", tracedir, tracefile);
+    if (stream_probe(path)) {
+	eval_stream(path, i, stats, NULL, 1);
+	return;
+    }
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_objs;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, i);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_libc_speed, &speed_params);
+	if (counters)
+	    eval_counters(eval_libc_speed, &speed_params, &stats->ctrs);
+	if (reps > 0)
+	    eval_runs(eval_libc_speed, &speed_params, stats->ops, &stats->runs);
+	if (touch_every > 0)
+	    eval_touch(trace, 1, &stats->touch);
+	if (latency)
+	    stats->lat = eval_latency(trace, 1);
+	if (nthreads > 0)
+	    eval_threads(trace, i, 1, &stats->scale);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_trace - Evaluate the mm package on trace number i, from
+ *    tracefile, into *stats. The heap must be initialized.
+ */
+static void eval_mm_trace(char *tracefile, int i, stats_t *stats,
+			  range_t **ranges)
+{
+    char path[MAXLINE];
+    trace_t *trace;
+    speed_t speed_params;
+
+    perfctr_clear(&stats->ctrs);
+    sprintf(path, "%s%s", tracedir, tracefile);
+    if (stream_probe(path)) {
+	eval_stream(path, i, stats, ranges, 0);
+	return;
+    }
+    trace = read_trace(tracedir, tracefile);
+    fit_heap(trace->sugg_heapsize);
+    stats->ops = trace->num_objs;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, i, ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+#if MM_PROFILE
+	mm_stats_reset();
+	stats->util = eval_mm_util(trace, i, ranges);
+	mm_stats(&stats->prof);
+#else
+	stats->util = eval_mm_util(trace, i, ranges);
+#endif
+	if (tl_every > 0)
+	    eval_timeline(trace, i, tracefile, &stats->tl);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	if (counters)
+	    eval_counters(eval_mm_speed, &speed_params, &stats->ctrs);
+	if (reps > 0)
+	    eval_runs(eval_mm_speed, &speed_params, stats->ops, &stats->runs);
+#if MM_PHASES
+	eval_phases(eval_mm_speed, &speed_params, stats);
+#endif
+#if MM_CACHESIM
+	eval_cachesim(eval_mm_speed, &speed_params, stats);
+#endif
+	if (touch_every > 0)
+	    eval_touch(trace, 0, &stats->touch);
+	if (latency)
+	    stats->lat = eval_latency(trace, 0);
+	if (nthreads > 0)
+	    stats->valid = eval_threads(trace, i, 0, &stats->scale);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_pool - Evaluate the n traces on the mm package, or libc malloc
+ *    if libc is set, each in a process of its own, with up to nprocs of
+ *    them running at once. Every worker starts from this process as it
+ *    was before any allocator ran, and is pinned to its own CPU, so the
+ *    workers neither share a heap nor move between caches. The results
+ *    come back over a pipe from each worker.
+ */
+static void eval_pool(char **tracefiles, int n, stats_t *stats, int libc)
+{
+    pid_t *pids;          /* worker in each slot, 0 if the slot is free */
+    int *fds;             /* read end of its pipe */
+    int *jobs;            /* and the trace it evaluates */
+    struct pollfd *pfds;
+    int fd[2];
+    int k, next = 0, active = 0;
+    double t0 = wall_secs();
+
+    pids = (pid_t *)calloc(nprocs, sizeof(pid_t));
+    fds = (int *)malloc(nprocs * sizeof(int));
+    jobs = (int *)malloc(nprocs * sizeof(int));
+    pfds = (struct pollfd *)malloc(nprocs * sizeof(struct pollfd));
+    if (pids == NULL || fds == NULL || jobs == NULL || pfds == NULL)
+	unix_error("malloc failed in eval_pool");
+
+    while (next < n || active > 0) {
+	/* Start a worker in every free slot while traces remain */
+	for (k = 0; k < nprocs && next < n; k++) {
+	    if (pids[k] != 0)
+		continue;
+	    if (pipe(fd) < 0)
+		unix_error("pipe failed in eval_pool");
+	    fflush(stdout);
+	    if ((pids[k] = fork()) < 0)
+		unix_error("fork failed in eval_pool");
+	    if (pids[k] == 0) {
+		close(fd[0]);
+		pool_worker(fd[1], k, tracefiles[next], next, libc);
+	    }
+	    close(fd[1]);
+	    fds[k] = fd[0];
+	    jobs[k] = next++;
+	    active++;
+	}
+
+	/* Collect the results of any workers that are done */
+	for (k = 0; k < nprocs; k++) {
+	    pfds[k].fd = (pids[k] != 0) ? fds[k] : -1;
+	    pfds[k].events = POLLIN;
+	    pfds[k].revents = 0;
+	}
+	if (poll(pfds, nprocs, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("poll failed in eval_pool");
+	}
+	for (k = 0; k < nprocs; k++) {
+	    if (pids[k] == 0 || pfds[k].revents == 0)
+		continue;
+	    pool_collect(fds[k], pids[k], jobs[k], &stats[jobs[k]]);
+	    close(fds[k]);
+	    pids[k] = 0;
+	    active--;
+	}
+    }
+
+    if (verbose)
+	printf("Evaluated %d traces on %s in %d processes in %.3f secs\n", 
+	       n, libc ? "libc malloc" : "mm malloc", nprocs, wall_secs() - t0);
+    free(pids);
+    free(fds);
+    free(jobs);
+    free(pfds);
+}
+
+/*
+ * pool_worker - The life of a worker process of eval_pool in slot: pin
+ *    itself to a CPU, evaluate trace number i from tracefile, and write
+ *    its stats, its error count and any latency histograms to fd
+ */
+static void pool_worker(int fd, int slot, char *tracefile, int i, int libc)
+{
+    stats_t stats;
+    range_t *ranges = NULL;
+
+    pin_cpu(slot);
+    memset(&stats, 0, sizeof(stats));
+    if (libc)
+	eval_libc_trace(tracefile, i, &stats);
+    else {
+	mem_init();
+	eval_mm_trace(tracefile, i, &stats, &ranges);
+    }
+
+    write_all(fd, &stats, sizeof(stats));
+    write_all(fd, &errors, sizeof(errors));
+    if (stats.lat != NULL)
+	write_all(fd, stats.lat, NREQTYPES * sizeof(hist_t));
+    fflush(stdout);
+    _exit(0);
+}
+
+/*
+ * pool_collect - Read the results of trace number i from the worker pid
+ *    at fd into *stats, and reap the worker. A worker that died before
+ *    sending them all counts as an error, and the trace as invalid.
+ */
+static void pool_collect(int fd, pid_t pid, int i, stats_t *stats)
+{
+    int status, errs;
+    int ok;
+
+    ok = read_all(fd, stats, sizeof(stats_t)) && 
+	read_all(fd, &errs, sizeof(errs));
+    if (ok && stats->lat != NULL) {
+	if ((stats->lat = (hist_t *)malloc(NREQTYPES * sizeof(hist_t))) == NULL)
+	    unix_error("malloc failed in pool_collect");
+	ok = read_all(fd, stats->lat, NREQTYPES * sizeof(hist_t));
+    }
+    if (waitpid(pid, &status, 0) < 0)
+	unix_error("waitpid failed in pool_collect");
+
+    if (!ok) {
+	memset(stats, 0, sizeof(stats_t));
+	errors++;
+	if (WIFSIGNALED(status))
+	    printf("ERROR [trace %d]: worker process killed by signal %d (%s)\n",
+		   i, WTERMSIG(status), strsignal(WTERMSIG(status)));
+	else
+	    printf("ERROR [trace %d]: worker process exited with status %d\n",
+		   i, WEXITSTATUS(status));
+	return;
+    }
+    errors += errs;
+}
+
+/*
+ * pin_cpu - Bind this process to one of the CPUs it may run on, picked
+ *    by slot so that workers in different slots get different CPUs
+ */
+static void pin_cpu(int slot)
+{
+    cpu_set_t avail, one;
+    int cpu, k;
+
+    if (sched_getaffinity(0, sizeof(avail), &avail) < 0)
+	return;
+    k = slot % CPU_COUNT(&avail);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	if (CPU_ISSET(cpu, &avail) && k-- == 0)
+	    break;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    sched_setaffinity(0, sizeof(one), &one);
+}
+
+/*
+ * read_all, write_all - Move exactly len bytes through a pipe. read_all
+ *    returns 0 if the other end closed first.
+ */
+static int read_all(int fd, void *buf, size_t len)
+{
+    ssize_t n;
+    char *p = (char *)buf;
+
+    while (len > 0) {
+	if ((n = read(fd, p, len)) < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 0;
+	p += n;
+	len -= n;
+    }
+    return 1;
+}
+
+static void write_all(int fd, void *buf, size_t len)
+{
+    ssize_t n;
+    char *p = (char *)buf;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("write failed in write_all");
+	}
+	p += n;
+	len -= n;
+    }
+}
+
+/*
+ * eval_counters - Count hardware events over one more run of f, one
+ *    of the functions fsecs times. A worker process opens counters of
+ *    its own.
+ */
+static void eval_counters(fsecs_test_funct f, void *argp, perfctr_t *pc)
+{
+    if (perfctr_open(NULL) == 0) {
+	perfctr_clear(pc);
+	return;
+    }
+    perfctr_start();
+    f(argp);
+    perfctr_stop(pc);
+}
+
+/*
+ * eval_runs - Time reps more runs of f, one of the functions fsecs
+ *    times, each on its own, and summarize their throughput for a
+ *    trace of ops ops. The runs are pinned to the CPU they start on,
+ *    and only they, so the threads of -j and -q may still spread out.
+ */
+static void eval_runs(fsecs_test_funct f, void *argp, double ops, bench_t *b)
+{
+    static int pin_warned = 0;
+    double *kops;
+    double t0;
+    int k;
+
+    if ((kops = (double *)malloc(reps * sizeof(double))) == NULL)
+	unix_error("malloc failed in eval_runs");
+    if (bench_pin() < 0 && !pin_warned) {
+	printf("Warning: could not pin the repeated runs to a CPU.\n");
+	pin_warned = 1;
+    }
+    for (k = 0; k < reps; k++) {
+	t0 = wall_secs();
+	f(argp);
+	kops[k] = (ops/1e3)/(wall_secs() - t0);
+    }
+    bench_unpin();
+    bench_summarize(kops, reps, b);
+    free(kops);
+}
+
+#if MM_PHASES
+/*
+ * eval_phases - Time one more run of f, one of the functions fsecs
+ *    times, in the TSC ticks mm's phase timers count in, and collect
+ *    the phase counts of that run
+ */
+static void eval_phases(fsecs_test_funct f, void *argp, stats_t *stats)
+{
+    unsigned long long t0;
+
+    mm_phases_reset();
+    t0 = get_tsc_serial();
+    f(argp);
+    stats->phase_ticks = get_tsc_serial() - t0;
+    mm_phases(&stats->phases);
+}
+#endif
+
+#if MM_CACHESIM
+/*
+ * eval_cachesim - Run f, one of the functions fsecs times, once more
+ *    with the simulated caches on, starting from empty caches, and
+ *    collect their counts. Only the mm package reports to them, so
+ *    the counts depend on nothing but its code and the trace.
+ */
+static void eval_cachesim(fsecs_test_funct f, void *argp, stats_t *stats)
+{
+    cachesim_reset(1);
+    f(argp);
+    cachesim_counts(&stats->sim);
+    cachesim_reset(0);
+}
+#endif
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
-    int index;
-    int size;
-    int oldsize;
-    char *newp;
-    char *oldp;
-    char *p;
-    
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
@@ -610,6 +2031,28 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	return 0;
     }
 
+    return valid_ops(trace, tracenum, ranges, 0);
+}
+
+/*
+ * valid_ops - Check the requests in trace->ops against the mm package
+ *     as it stands. base is the number of requests already checked,
+ *     for the line numbers in error messages.
+ */
+static int valid_ops(trace_t *trace, int tracenum, range_t **ranges,
+		     long base)
+{
+    long i;
+    long index;
+    size_t size;
+    size_t oldsize;
+    size_t oldusable;
+    size_t usable;
+    int j, count;
+    char *newp;
+    char *oldp;
+    char *p;
+    
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
 	index = trace->ops[i].index;
@@ -621,16 +2064,19 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
 	    /* Call the student's malloc */
 	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+		malloc_error(tracenum, base + i, "mm_malloc failed.");
 		return 0;
 	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
-	     * and must not overlap any currently allocated block. 
+	     * to the range tree if OK. The block must be  be aligned properly,
+	     * and must not overlap any currently allocated block. The range
+	     * covers the whole usable size, so the slack must be real.
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if ((usable = check_usable(p, size, tracenum, base + i)) == 0)
+		return 0;
+	    if (add_range(ranges, p, usable, ALIGNMENT, tracenum, base + i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -638,7 +2084,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    fill_payload(p, usable, index & 0xFF);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
@@ -649,16 +2095,19 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
+	    oldusable = mm_usable_size(oldp);
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
-		malloc_error(tracenum, i, "mm_realloc failed.");
+		malloc_error(tracenum, base + i, "mm_realloc failed.");
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+	    /* Check new block for correctness and add it to range tree */
+	    if ((usable = check_usable(newp, size, tracenum, base + i)) == 0)
+		return 0;
+	    if (add_range(ranges, newp, usable, ALIGNMENT, tracenum, base + i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -668,14 +2117,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
-	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
-		malloc_error(tracenum, i, "mm_realloc did not preserve the "
+	    if (!check_payload(newp, oldusable, oldsize, index & 0xFF)) {
+		malloc_error(tracenum, base + i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
-	      }
 	    }
-	    memset(newp, index & 0xFF, size);
+	    fill_payload(newp, usable, index & 0xFF);
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
@@ -684,12 +2131,100 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case FREE: /* mm_free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Make sure the block still holds what was written to it, then 
+	       remove region from list and call student's free function */
 	    p = trace->blocks[index];
+	    if (!intact(p, index, tracenum, base + i))
+		return 0;
 	    remove_range(ranges, p);
 	    mm_free(p);
 	    break;
 
+        case CALLOC: /* mm_calloc */
+
+	    /* Same checks as mm_malloc, after making sure the 
+	       requested bytes came back zeroed */
+	    if ((p = mm_calloc(1, size)) == NULL) {
+		malloc_error(tracenum, base + i, "mm_calloc failed.");
+		return 0;
+	    }
+	    if (!check_payload(p, size, size, 0)) {
+		malloc_error(tracenum, base + i, "mm_calloc did not zero the "
+			     "block");
+		return 0;
+	    }
+	    if ((usable = check_usable(p, size, tracenum, base + i)) == 0)
+		return 0;
+	    if (add_range(ranges, p, usable, ALIGNMENT, tracenum, base + i) == 0)
+		return 0;
+	    fill_payload(p, usable, index & 0xFF);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+
+	    /* Same checks as mm_malloc, against the requested alignment */
+	    if ((p = mm_memalign(trace->ops[i].align, size)) == NULL) {
+		malloc_error(tracenum, base + i, "mm_memalign failed.");
+		return 0;
+	    }
+	    if ((usable = check_usable(p, size, tracenum, base + i)) == 0)
+		return 0;
+	    if (add_range(ranges, p, usable, trace->ops[i].align, 
+			  tracenum, base + i) == 0)
+		return 0;
+	    fill_payload(p, usable, index & 0xFF);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE_SIZED: /* mm_free_sized */
+
+	    /* Same, passing the size the block was last requested with */
+	    p = trace->blocks[index];
+	    if (!intact(p, index, tracenum, base + i))
+		return 0;
+	    remove_range(ranges, p);
+	    mm_free_sized(p, trace->block_sizes[index]);
+	    break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+
+	    /* The ids of a batch are consecutive, so the blocks land
+	       directly in their slots of the blocks array */
+	    count = trace->ops[i].count;
+	    if (mm_malloc_batch(size, count, 
+				(void **)&trace->blocks[index]) != count) {
+		malloc_error(tracenum, base + i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check each block and fill it just like a single malloc */
+	    for (j = 0; j < count; j++) {
+		p = trace->blocks[index + j];
+		if ((usable = check_usable(p, size, tracenum, base + i)) == 0)
+		    return 0;
+		if (add_range(ranges, p, usable, ALIGNMENT, tracenum, base + i) == 0)
+		    return 0;
+		fill_payload(p, usable, (index + j) & 0xFF);
+		trace->block_sizes[index + j] = size;
+	    }
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+
+	    /* The freed slots are dead, so mm_free_batch may reorder them */
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++) {
+		p = trace->blocks[index + j];
+		if (!intact(p, index + j, tracenum, base + i))
+		    return 0;
+		remove_range(ranges, p);
+	    }
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -713,23 +2248,37 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {   
-    int i;
-    int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
-    char *p;
-    char *newp, *oldp;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    util_ops(trace, &total_size, &max_total_size);
+    return ((double)max_total_size / (double)mem_heapsize());
+}
 
-        case ALLOC: /* mm_alloc */
+/*
+ * util_ops - Run the requests in trace->ops on the mm package, keeping
+ *     the total payload in *total_size and its peak in *max_total_size
+ */
+static void util_ops(trace_t *trace, size_t *total_size_p,
+		     size_t *max_total_p)
+{
+    long i, index;
+    int j, count;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = *max_total_p;
+    size_t total_size = *total_size_p;
+    char *p;
+    char *newp, *oldp;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_alloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
@@ -764,7 +2313,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
-	    total_size += (newsize - oldsize);
+	    total_size = total_size - oldsize + newsize;
 	    
 	    /* Update statistics */
 	    max_total_size = (total_size > max_total_size) ?
@@ -784,15 +2333,274 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+
+	    if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else
+		p = mm_memalign(trace->ops[i].align, size);
+	    if (p == NULL) 
+		app_error("mm_memalign/mm_calloc failed in eval_mm_util");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case FREE_SIZED: /* mm_free_sized */
+	    index = trace->ops[i].index;
+	    size = trace->block_sizes[index];
+	    mm_free_sized(trace->blocks[index], size);
+	    total_size -= size;
+	    break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+
+	    if (mm_malloc_batch(size, count, 
+				(void **)&trace->blocks[index]) != count)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+
+	    for (j = 0; j < count; j++)
+		trace->block_sizes[index + j] = size;
+	    total_size += size * count;
+
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+
+	    for (j = 0; j < count; j++)
+		total_size -= trace->block_sizes[index + j];
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    *total_size_p = total_size;
+    *max_total_p = max_total_size;
+}
+
+
+/*
+ * eval_soak - Replay the n traces in turn, iters times in all, on one
+ *     heap that is never reset, freeing the blocks each replay leaves
+ *     behind before the next. Every so many replays, print their
+ *     throughput, util (peak payload over the heap size, which only
+ *     grows), the heap size, and the fragmentation halfway through a
+ *     replay; at the end, how much these drifted from the first such
+ *     window to the last. By default a window is about a twentieth of
+ *     the replays, in whole rounds of the traces. Returns 0 if a trace
+ *     failed the check that comes first.
+ */
+static int eval_soak(char **tracefiles, int n, long iters, long every)
+{
+    trace_t **traces, *tr, part;
+    long **left, *nleft;
+    range_t *ranges = NULL;
+    size_t total_size, max_total_size;
+    mm_heapinfo_t hi;
+    double t0, t1, secs, ops, util, ext, fblocks, heap;
+    double first[4] = {0}, last[4] = {0};
+    long k, j, w;
+    int t;
+    char path[MAXLINE];
+
+    if ((traces = calloc(n, sizeof(trace_t *))) == NULL ||
+	(left = calloc(n, sizeof(long *))) == NULL ||
+	(nleft = calloc(n, sizeof(long))) == NULL)
+	unix_error("calloc failed in eval_soak");
+
+    /* Check each trace on a heap of its own first */
+    for (t = 0; t < n; t++) {
+	sprintf(path, "%s%s", tracedir, tracefiles[t]);
+	if (stream_probe(path)) {
+	    printf("ERROR: %s is a stream trace, which -k cannot replay\n",
+		   tracefiles[t]);
+	    return 0;
+	}
+	traces[t] = read_trace(tracedir, tracefiles[t]);
+	fit_heap(traces[t]->sugg_heapsize);
+	if (!eval_mm_valid(traces[t], t, &ranges))
+	    return 0;
+	left[t] = live_at_end(traces[t], &nleft[t]);
+    }
+    clear_ranges(&ranges);
+    if (every == 0)
+	every = (MAX(iters / 20, 1) + n - 1) / n * n;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_soak");
+
+    printf("Soaking one heap in %ld replays of %d trace%s:\n", iters, n,
+	   (n == 1) ? "" : "s");
+    printf("%9s%10s%7s%12s%9s%12s\n", 
+	   "replays", "Kops", "util", "heap", "ext frag", "free blocks");
+    secs = ops = util = ext = fblocks = 0;
+    for (k = 0; k < iters; k++) {
+	tr = traces[k % n];
+	total_size = max_total_size = 0;
+
+	/* Replay the first half, look at the heap, and replay the rest */
+	part = *tr;
+	part.num_ops = tr->num_ops / 2;
+	t0 = wall_secs();
+	util_ops(&part, &total_size, &max_total_size);
+	t1 = wall_secs();
+	mm_heapinfo(&hi);
+	part.ops = tr->ops + part.num_ops;
+	part.num_ops = tr->num_ops - part.num_ops;
+	secs += t1 - t0;
+	t0 = wall_secs();
+	util_ops(&part, &total_size, &max_total_size);
+	secs += wall_secs() - t0;
+
+	/* Whatever the trace did not free, so the next replay starts
+	   from an empty heap that is as old as all the replays before */
+	for (j = 0; j < nleft[k % n]; j++)
+	    mm_free(tr->blocks[left[k % n][j]]);
+
+	ops += tr->num_objs;
+	util += (double)max_total_size / mem_heapsize();
+	ext += hi.free_bytes ? 1 - (double)hi.largest_free / hi.free_bytes : 0;
+	fblocks += hi.free_blocks;
+
+	if ((k + 1) % every == 0 || k + 1 == iters) {
+	    w = (k % every) + 1;
+	    heap = mem_heapsize();
+	    last[0] = (ops/1e3)/secs;
+	    last[1] = util / w;
+	    last[2] = heap;
+	    last[3] = ext / w;
+	    if (k + 1 == w)
+		memcpy(first, last, sizeof(first));
+	    printf("%9ld%10.0f%6.1f%%%12.0f%8.1f%%%12.1f\n", 
+		   k + 1, last[0], last[1]*100.0, heap, last[3]*100.0, 
+		   fblocks / w);
+	    secs = ops = util = ext = fblocks = 0;
+	}
+    }
+    printf("Drift from the first %ld replays to the last: Kops %+.1f%%, "
+	   "util %+.1f pts, heap %+.1f%%, ext frag %+.1f pts\n",
+	   MIN(every, iters), (last[0] - first[0]) / first[0] * 100.0,
+	   (last[1] - first[1]) * 100.0, (last[2] - first[2]) / first[2] * 100.0,
+	   (last[3] - first[3]) * 100.0);
+
+    for (t = 0; t < n; t++) {
+	free(left[t]);
+	free_trace(traces[t]);
+    }
+    free(traces);
+    free(left);
+    free(nleft);
+    return 1;
+}
+
+/*
+ * live_at_end - The ids of the blocks the trace leaves allocated, in a
+ *     new array of *nleft of them
+ */
+static long *live_at_end(trace_t *trace, long *nleft)
+{
+    char *live;
+    long *ids;
+    long i, index;
+    int j;
+
+    if ((live = calloc(trace->num_ids, 1)) == NULL)
+	unix_error("calloc failed in live_at_end");
+    for (i = 0; i < trace->num_ops; i++) {
+	index = trace->ops[i].index;
+	switch (trace->ops[i].type) {
+	case ALLOC: case REALLOC: case MEMALIGN: case CALLOC:
+	    live[index] = 1;
+	    break;
+	case FREE: case FREE_SIZED:
+	    live[index] = 0;
+	    break;
+	case ALLOC_BATCH: case FREE_BATCH:
+	    for (j = 0; j < trace->ops[i].count; j++)
+		live[index + j] = (trace->ops[i].type == ALLOC_BATCH);
+	    break;
+	}
+    }
+    if ((ids = malloc(trace->num_ids * sizeof(long))) == NULL)
+	unix_error("malloc failed in live_at_end");
+    for (i = *nleft = 0; i < trace->num_ids; i++)
+	if (live[i])
+	    ids[(*nleft)++] = i;
+    free(live);
+    return ids;
 }
 
+/*
+ * eval_timeline - Replay the trace on a new mm heap tl_every ops at a
+ *     time, and after each stretch sample the live payload, the heap
+ *     size and the heap's own census of its blocks. The samples are
+ *     appended to tl_fd as CSV rows and summarized in *tl.
+ */
+static void eval_timeline(trace_t *trace, int tracenum, char *name,
+			  timeline_t *tl)
+{
+    trace_t part = *trace;
+    size_t total_size = 0, max_total_size = 0;
+    mm_heapinfo_t hi;
+    double heap, util, ext, intl, w;
+    long done;
+    FILE *fp;
+    char *buf;
+    size_t len;
+
+    memset(tl, 0, sizeof(*tl));
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_timeline");
+    if ((fp = open_memstream(&buf, &len)) == NULL)
+	unix_error("open_memstream failed in eval_timeline");
+
+    for (done = 0; done < trace->num_ops; done += part.num_ops) {
+	part.ops = trace->ops + done;
+	part.num_ops = MIN(tl_every, trace->num_ops - done);
+	util_ops(&part, &total_size, &max_total_size);
+
+	mm_heapinfo(&hi);
+	heap = mem_heapsize();
+	util = total_size / heap;
+	ext = hi.free_bytes ? 1 - (double)hi.largest_free / hi.free_bytes : 0;
+	intl = hi.alloc_bytes ? 
+	    (double)(hi.alloc_bytes - total_size) / hi.alloc_bytes : 0;
+
+	w = (double)part.num_ops / trace->num_ops;
+	tl->samples++;
+	tl->twutil += util * w;
+	tl->ext_avg += ext * w;
+	tl->int_avg += intl * w;
+	tl->ext_max = MAX(tl->ext_max, ext);
+
+	fprintf(fp, "%d,%s,%ld,%zu,%.0f,%zu,%zu,%zu,%zu,%.4f,%.4f\n", 
+		tracenum, name, done + part.num_ops, total_size, heap, 
+		hi.free_bytes, hi.largest_free, hi.free_blocks, 
+		hi.alloc_bytes - total_size, ext, util);
+    }
+    fclose(fp);
+    write_all(tl_fd, buf, len);
+    free(buf);
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -800,15 +2608,25 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
-
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
     if (mm_init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
+    speed_ops(((speed_t *)ptr)->trace);
+}
+
+/*
+ * speed_ops - Run the requests in trace->ops on the mm package with
+ *     no checking. Block sizes are kept for the sized frees.
+ */
+static void speed_ops(trace_t *trace)
+{
+    long i, index;
+    int j, count;
+    size_t size, newsize;
+    char *p, *newp, *oldp, *block;
+
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
         switch (trace->ops[i].type) {
@@ -819,6 +2637,7 @@ static void eval_mm_speed(void *ptr)
             if ((p = mm_malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
             break;
 
 	case REALLOC: /* mm_realloc */
@@ -828,6 +2647,7 @@ static void eval_mm_speed(void *ptr)
             if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
+            trace->block_sizes[index] = newsize;
             break;
 
         case FREE: /* mm_free */
@@ -836,103 +2656,1120 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case FREE_SIZED: /* mm_free_sized */
+            index = trace->ops[i].index;
+            mm_free_sized(trace->blocks[index], trace->block_sizes[index]);
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            count = trace->ops[i].count;
+            if (mm_malloc_batch(size, count, 
+				(void **)&trace->blocks[index]) != count)
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            for (j = 0; j < count; j++)
+                trace->block_sizes[index + j] = size;
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            mm_free_batch((void **)&trace->blocks[index], count);
+            break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_stream - Evaluate the stream trace at path on the mm package,
+ *    or on libc malloc if libc is set. The mm package gets the usual
+ *    correctness, utilization and timing passes, and libc only the
+ *    timed one. Each pass decodes the trace afresh, and a pass sees
+ *    one block of requests at a time as if it were a whole trace. The
+ *    time is the CPU time of this thread alone, so neither the decoder
+ *    thread nor waiting for it is counted. The one timed pass stands in
+ *    for the K-best runs of an in-memory trace.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_stream(char *path, int tracenum, stats_t *stats,
+			range_t **ranges, int libc)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    stream_info_t info;
+    stream_t *s;
+    trace_t piece;           /* the current block of requests */
+    speed_t speed_params;
+    size_t total_size = 0, max_total_size = 0;
+    long base = 0;
+    int pass;
+    double start;
+
+    if (verbose > 1)
+	printf("Streaming tracefile: %s\n", path);
+
+    /* The blocks arrays hold every id slot for the whole trace */
+    s = stream_open(path, &info);
+    stream_close(s);
+    if (!libc)
+	fit_heap(info.sugg_heapsize);
+    piece.num_ids = info.num_ids;
+    if ((piece.blocks = 
+	 (char **)malloc(info.num_ids * sizeof(char *))) == NULL ||
+	(piece.block_sizes = 
+	 (size_t *)malloc(info.num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc failed in eval_stream");
+    speed_params.trace = &piece;
+
+    stats->ops = info.num_objs;
+    stats->valid = 1;
+    stats->stream = 1;
+    stats->secs = 0;
+    for (pass = libc ? 2 : 0; stats->valid && pass < 3; pass++) {
+	if (!libc) {
+	    mem_reset_brk();
+	    clear_ranges(ranges);
+	    if (mm_init() < 0) {
+		malloc_error(tracenum, 0, "mm_init failed.");
+		stats->valid = 0;
+		break;
+	    }
+	}
+
+	s = stream_open(path, &info);
+	while (stats->valid && 
+	       (piece.ops = stream_next(s, &piece.num_ops)) != NULL) {
+	    switch (pass) {
+	    case 0: /* correctness */
+		stats->valid = valid_ops(&piece, tracenum, ranges, base);
+		base += piece.num_ops;
+		break;
+	    case 1: /* utilization */
+		util_ops(&piece, &total_size, &max_total_size);
+		break;
+	    case 2: /* throughput */
+		start = thread_secs();
+		if (libc)
+		    eval_libc_speed(&speed_params);
+		else
+		    speed_ops(&piece);
+		stats->secs += thread_secs() - start;
+		break;
+	    }
+	}
+	stream_close(s);
+
+	if (pass == 1)
+	    stats->util = (double)max_total_size / (double)mem_heapsize();
+    }
+
+    free(piece.blocks);
+    free(piece.block_sizes);
+}
+
+/*
+ * eval_latency - Replay the trace once, timing every request on its own
+ *    between two serialized TSC reads, and count each time, less the
+ *    timer's own overhead, in the histogram for its request type. Runs
+ *    libc malloc if libc is set and the mm package otherwise. Returns
+ *    the NREQTYPES histograms.
+ */
+static hist_t *eval_latency(trace_t *trace, int libc)
+{
+    long i, index;
+    int j, count;
+    size_t size;
+    unsigned long long t0, t1;
+    hist_t *lat;
+    char *p = NULL;
+    char **blocks = trace->blocks;
+
+    if ((lat = (hist_t *)malloc(NREQTYPES * sizeof(hist_t))) == NULL)
+	unix_error("malloc failed in eval_latency");
+    for (i = 0; i < NREQTYPES; i++)
+	hist_init(&lat[i]);
+
+    if (!libc) {
+	mem_reset_brk();
+	if (mm_init() < 0) 
+	    app_error("mm_init failed in eval_latency");
+    }
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	count = trace->ops[i].count;
+
+	t0 = get_tsc_serial();
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = p;
+	    p = blocks[index] = libc ? malloc(size) : mm_malloc(size);
 	    break;
 
 	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
-	    if ((newp = realloc(oldp, newsize)) == NULL) {
-		malloc_error(tracenum, i, "libc realloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	    p = blocks[index] = libc ? realloc(blocks[index], size) :
+		mm_realloc(blocks[index], size);
 	    break;
-	    
+
         case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+	    if (libc)
+		free(blocks[index]);
+	    else
+		mm_free(blocks[index]);
 	    break;
 
-	default:
-	    app_error("invalid operation type  in eval_libc_valid");
+        case FREE_SIZED: /* sized free */
+	    if (libc)
+		free(blocks[index]);
+	    else
+		mm_free_sized(blocks[index], trace->block_sizes[index]);
+	    break;
+
+        case ALLOC_BATCH: /* batch malloc */
+	    if (libc) {
+		for (j = 0; j < count; j++)
+		    if ((p = blocks[index + j] = malloc(size)) == NULL)
+			break;
+	    }
+	    else
+		p = (mm_malloc_batch(size, count, (void **)&blocks[index]) ==
+		     count) ? blocks[index] : NULL;
+	    break;
+
+        case FREE_BATCH: /* batch free */
+	    if (libc) {
+		for (j = 0; j < count; j++)
+		    free(blocks[index + j]);
+	    }
+	    else
+		mm_free_batch((void **)&blocks[index], count);
+	    break;
+
+        case MEMALIGN: /* memalign */
+	    if (libc) {
+		if (posix_memalign((void **)&p, trace->ops[i].align, size) != 0)
+		    p = NULL;
+	    }
+	    else
+		p = mm_memalign(trace->ops[i].align, size);
+	    blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    p = blocks[index] = libc ? calloc(1, size) : mm_calloc(1, size);
+	    break;
 	}
+	t1 = get_tsc_serial();
+
+	if (p == NULL)
+	    app_error("Allocation failed in eval_latency");
+	if (trace->ops[i].type == ALLOC_BATCH)
+	    for (j = 0; j < count; j++)
+		trace->block_sizes[index + j] = size;
+	else if (trace->ops[i].type != FREE && trace->ops[i].type != FREE_SIZED
+		 && trace->ops[i].type != FREE_BATCH)
+	    trace->block_sizes[index] = size;
+	hist_record(&lat[trace->ops[i].type], 
+		    (t1 - t0 > tsc_ovhd) ? t1 - t0 - tsc_ovhd : 0);
     }
+    return lat;
+}
 
-    return 1;
+/*
+ * eval_touch - Time replays of the trace that write every payload they
+ *    allocate and sweep over the live blocks every touch_every ops, on
+ *    libc malloc if libc is set and the mm package otherwise, and count
+ *    the hardware events of one more. How close together the allocator
+ *    put blocks that are used together shows in the time and the cache
+ *    misses, which the plain replays never see.
+ */
+static void eval_touch(trace_t *trace, int libc, touch_t *touch)
+{
+    speed_t speed_params;
+    fsecs_test_funct f = libc ? eval_libc_touch : eval_mm_touch;
+
+    speed_params.trace = trace;
+    speed_params.ranges = NULL;
+    if ((speed_params.order = (long *)malloc(trace->num_ids * sizeof(long)))
+	== NULL || (speed_params.listed = (char *)malloc(trace->num_ids)) == NULL)
+	unix_error("malloc failed in eval_touch");
+    touch->sweeps = trace->num_ops / touch_every;
+    touch->secs = fsecs(f, &speed_params);
+    eval_counters(f, &speed_params, &touch->ctrs);
+    free(speed_params.order);
+    free(speed_params.listed);
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * eval_mm_touch, eval_libc_touch - The touch replays that fsecs times
  */
-static void eval_libc_speed(void *ptr)
+static void eval_mm_touch(void *ptr)
 {
-    int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_touch");
+    touch_ops(((speed_t *)ptr)->trace, ((speed_t *)ptr)->order, 
+	      ((speed_t *)ptr)->listed, 0);
+}
+
+static void eval_libc_touch(void *ptr)
+{
+    touch_ops(((speed_t *)ptr)->trace, ((speed_t *)ptr)->order, 
+	      ((speed_t *)ptr)->listed, 1);
+}
+
+/*
+ * touch_ops - Run the requests in trace->ops on libc malloc if libc is
+ *     set and the mm package otherwise, fill each payload that is
+ *     allocated or reallocated as a program would, and sweep the live
+ *     blocks after every touch_every requests. Like the checks, both
+ *     skip the middle of a block over FILL_MAX. order lists the ids of
+ *     the blocks in the order they were allocated; a freed block's
+ *     entry in trace->blocks is cleared, and the sweep drops it from
+ *     the list. listed marks the ids on the list, so that an id freed
+ *     and allocated again between two sweeps keeps the entry it has,
+ *     and the list never holds more than num_ids entries.
+ */
+static void touch_ops(trace_t *trace, long *order, char *listed, int libc)
+{
+    long i, index, n = 0;
+    int j, count, type;
+    size_t size;
+    char *p = NULL;
+    char **blocks = trace->blocks;
+    unsigned int seed = 2463534242u;
 
+    memset(listed, 0, trace->num_ids);
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	count = trace->ops[i].count;
+	type = trace->ops[i].type;
+
+        switch (type) {
+
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
-		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
+	    p = blocks[index] = libc ? malloc(size) : mm_malloc(size);
 	    break;
 
 	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-	    if ((newp = realloc(oldp, newsize)) == NULL)
-		unix_error("realloc failed in eval_libc_speed\n");
-	    
-	    trace->blocks[index] = newp;
+	    p = blocks[index] = libc ? realloc(blocks[index], size) :
+		mm_realloc(blocks[index], size);
 	    break;
-	    
+
         case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
-	    free(block);
+	    if (libc)
+		free(blocks[index]);
+	    else
+		mm_free(blocks[index]);
+	    blocks[index] = NULL;
+	    break;
+
+        case FREE_SIZED: /* sized free */
+	    if (libc)
+		free(blocks[index]);
+	    else
+		mm_free_sized(blocks[index], trace->block_sizes[index]);
+	    blocks[index] = NULL;
+	    break;
+
+        case ALLOC_BATCH: /* batch malloc */
+	    if (libc) {
+		for (j = 0; j < count; j++)
+		    if ((p = blocks[index + j] = malloc(size)) == NULL)
+			break;
+	    }
+	    else
+		p = (mm_malloc_batch(size, count, (void **)&blocks[index]) ==
+		     count) ? blocks[index] : NULL;
+	    break;
+
+        case FREE_BATCH: /* batch free */
+	    if (libc) {
+		for (j = 0; j < count; j++)
+		    free(blocks[index + j]);
+	    }
+	    else
+		mm_free_batch((void **)&blocks[index], count);
+	    for (j = 0; j < count; j++)
+		blocks[index + j] = NULL;
+	    break;
+
+        case MEMALIGN: /* memalign */
+	    if (libc) {
+		if (posix_memalign((void **)&p, trace->ops[i].align, size) != 0)
+		    p = NULL;
+	    }
+	    else
+		p = mm_memalign(trace->ops[i].align, size);
+	    blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    p = blocks[index] = libc ? calloc(1, size) : mm_calloc(1, size);
 	    break;
+
+	default:
+	    app_error("Nonexistent request type in touch_ops");
 	}
-    }
-}
 
-/*************************************
- * Some miscellaneous helper routines
- ************************************/
+	/* A new block is filled and goes on the end of the list; a
+	   reallocated one, or one whose id is still listed, is filled
+	   again but keeps its place */
+	if (type != FREE && type != FREE_SIZED && type != FREE_BATCH) {
+	    if (p == NULL)
+		app_error("Allocation failed in touch_ops");
+	    if (type != ALLOC_BATCH)
+		count = 1;
+	    for (j = 0; j < count; j++) {
+		fill_payload(blocks[index + j], size, (int)(index + j));
+		trace->block_sizes[index + j] = size;
+		if (!listed[index + j]) {
+		    listed[index + j] = 1;
+		    order[n++] = index + j;
+		}
+	    }
+	}
 
+	if ((i + 1) % touch_every == 0)
+	    n = touch_sweep(trace, order, listed, n, 
+			    touch_random ? &seed : NULL);
+    }
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * touch_sweep - Read one word from each cache line that touch_ops
+ *     filled in each live block on the list of n ids, in order, or
+ *     shuffled first by the xorshift generator at *seed if seed is not
+ *     NULL. Returns the length of the list once the freed blocks are
+ *     dropped from it, and from listed.
+ */
+static long touch_sweep(trace_t *trace, long *order, char *listed, long n, 
+			unsigned int *seed)
+{
+    static volatile long sink;
+    long i, k, t, sum = 0;
+    size_t off, size;
+    char *p;
+
+    for (i = k = 0; i < n; i++)
+	if (trace->blocks[order[i]] != NULL)
+	    order[k++] = order[i];
+	else
+	    listed[order[i]] = 0;
+    n = k;
+
+    if (seed != NULL)
+	for (i = n - 1; i > 0; i--) {
+	    *seed ^= *seed << 13;
+	    *seed ^= *seed >> 17;
+	    *seed ^= *seed << 5;
+	    k = *seed % (i + 1);
+	    t = order[i];
+	    order[i] = order[k];
+	    order[k] = t;
+	}
+
+    for (i = 0; i < n; i++) {
+	p = trace->blocks[order[i]];
+	size = trace->block_sizes[order[i]];
+	for (off = 0; off < size; off += 64) {
+	    if (size > FILL_MAX && off == FILL_SPAN)
+		off = size - FILL_SPAN;    /* skip the unfilled middle */
+	    sum += p[off];
+	}
+    }
+    sink += sum;
+    return n;
+}
+
+/*
+ * eval_threads - Replay the trace in 1 to nthreads threads at once,
+ *    each taking the requests for its own share of the blocks, and keep
+ *    the best of three runs at each thread count in *scale. The mm
+ *    package is first checked with all nthreads threads running, each
+ *    keeping its own range tree; an overlap between blocks of different
+ *    threads shows up as a payload overwritten before it is freed. Line
+ *    numbers in those errors count the requests of one thread. Returns
+ *    0 if the check failed. A trace whose batches cannot be split among
+ *    the threads is skipped and leaves *scale NULL. Each thread count
+ *    also gets the best of three serial runs of its parts, one after
+ *    another in a single thread, so that its speedup compares the same
+ *    requests in the same order within each part, run the same way.
+ */
+static int eval_threads(trace_t *trace, int tracenum, int libc,
+			scale_t **scale)
+{
+    trace_t *parts, *seq;
+    worker_t *w;
+    scale_t *sc;
+    double secs;
+    int n, t, k;
+    int valid = 1;
+
+    *scale = NULL;
+    if ((parts = split_trace(trace, nthreads)) == NULL) {
+	if (verbose)
+	    printf("Trace %d has batches shared between threads, "
+		   "so it is not replayed in threads.\n", tracenum);
+	return 1;
+    }
+    if ((w = (worker_t *)malloc(nthreads * sizeof(worker_t))) == NULL ||
+	(sc = (scale_t *)calloc(nthreads, sizeof(scale_t))) == NULL)
+	unix_error("malloc failed in eval_threads");
+
+    if (!libc) {
+	mm_set_threaded(1);
+	mem_reset_brk();
+	if (mm_init() < 0) 
+	    app_error("mm_init failed in eval_threads");
+	run_threads(parts, nthreads, w, tracenum, 0, 1);
+	for (t = 0; t < nthreads; t++)
+	    valid &= w[t].valid;
+    }
+    free_parts(parts, nthreads);
+
+    for (n = 1; valid && n <= nthreads; n++) {
+	if ((parts = split_trace(trace, n)) == NULL)
+	    continue;
+	if ((sc[n-1].kops = (double *)malloc(n * sizeof(double))) == NULL)
+	    unix_error("malloc failed in eval_threads");
+	seq = join_parts(parts, n);
+	sc[n-1].secs = sc[n-1].serial = DBL_MAX;
+	for (k = 0; k < 3; k++) {
+	    if (!libc) {
+		mem_reset_brk();
+		if (mm_init() < 0) 
+		    app_error("mm_init failed in eval_threads");
+	    }
+	    sc[n-1].serial = MIN(sc[n-1].serial, 
+				 run_threads(seq, 1, w, tracenum, libc, 0));
+	    if (!libc) {
+		mem_reset_brk();
+		if (mm_init() < 0) 
+		    app_error("mm_init failed in eval_threads");
+	    }
+	    if ((secs = run_threads(parts, n, w, tracenum, libc, 0)) 
+		>= sc[n-1].secs)
+		continue;
+	    sc[n-1].secs = secs;
+	    for (t = 0; t < n; t++)
+		sc[n-1].kops[t] = (parts[t].num_objs/1e3)/(w[t].end - w[t].begin);
+	}
+	free_parts(seq, 1);
+	free_parts(parts, n);
+    }
+
+    if (!libc)
+	mm_set_threaded(0);
+    free(w);
+    *scale = sc;
+    return valid;
+}
+
+/*
+ * split_trace - Deal the requests of trace out to n threads. Each block
+ *    id belongs to the thread its first allocation is dealt to, id % n,
+ *    and every later request for it goes to that thread too, so the
+ *    threads never touch each other's blocks. The parts share the
+ *    blocks arrays of trace. Returns NULL if a batch would hold ids of
+ *    more than one thread.
+ */
+static trace_t *split_trace(trace_t *trace, int n)
+{
+    trace_t *parts;
+    int *owner;    /* thread of each id, -1 until it is first seen */
+    int *to;       /* thread of each request */
+    long i, index, k;
+    int j, t, count;
+
+    parts = (trace_t *)calloc(n, sizeof(trace_t));
+    owner = (int *)malloc(trace->num_ids * sizeof(int));
+    to = (int *)malloc(trace->num_ops * sizeof(int));
+    if (parts == NULL || owner == NULL || to == NULL)
+	unix_error("malloc failed in split_trace");
+    for (i = 0; i < trace->num_ids; i++)
+	owner[i] = -1;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	index = trace->ops[i].index;
+	count = (trace->ops[i].type == ALLOC_BATCH ||
+		 trace->ops[i].type == FREE_BATCH) ? trace->ops[i].count : 1;
+	t = (owner[index] < 0) ? index % n : owner[index];
+	for (j = 0; j < count; j++) {
+	    if (owner[index + j] >= 0 && owner[index + j] != t) {
+		free(parts);
+		parts = NULL;
+		goto out;
+	    }
+	    owner[index + j] = t;
+	}
+	to[i] = t;
+	parts[t].num_ops++;
+	parts[t].num_objs += count;
+    }
+
+    for (t = 0; t < n; t++) {
+	parts[t].sugg_heapsize = trace->sugg_heapsize;
+	parts[t].num_ids = trace->num_ids;
+	parts[t].weight = trace->weight;
+	parts[t].blocks = trace->blocks;
+	parts[t].block_sizes = trace->block_sizes;
+	parts[t].ops = (traceop_t *)malloc((parts[t].num_ops + 1) * 
+					   sizeof(traceop_t));
+	if (parts[t].ops == NULL)
+	    unix_error("malloc failed in split_trace");
+	parts[t].num_ops = 0;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	k = parts[to[i]].num_ops++;
+	parts[to[i]].ops[k] = trace->ops[i];
+    }
+
+ out:
+    free(owner);
+    free(to);
+    return parts;
+}
+
+/*
+ * free_parts - Free the n parts made by split_trace
+ */
+static void free_parts(trace_t *parts, int n)
+{
+    int t;
+
+    for (t = 0; t < n; t++)
+	free(parts[t].ops);
+    free(parts);
+}
+
+/*
+ * join_parts - Make one part of the n parts made by split_trace, with
+ *    the requests of each in turn; free it with free_parts(p, 1)
+ */
+static trace_t *join_parts(trace_t *parts, int n)
+{
+    trace_t *seq;
+    long k = 0;
+    int t;
+
+    if ((seq = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc failed in join_parts");
+    *seq = parts[0];
+    for (t = 1; t < n; t++) {
+	seq->num_ops += parts[t].num_ops;
+	seq->num_objs += parts[t].num_objs;
+    }
+    if ((seq->ops = (traceop_t *)malloc((seq->num_ops + 1) * 
+					sizeof(traceop_t))) == NULL)
+	unix_error("malloc failed in join_parts");
+    for (t = 0; t < n; t++) {
+	memcpy(seq->ops + k, parts[t].ops, parts[t].num_ops * sizeof(traceop_t));
+	k += parts[t].num_ops;
+    }
+    return seq;
+}
+
+/*
+ * run_threads - Start a thread for each of the n parts, let them all go
+ *    at once, and return the wall time from the first one starting to
+ *    the last one being done. This thread may well not run again until
+ *    they are all done, so it takes neither time itself. The workers in
+ *    w get each thread's own times and, if check is set, its verdict.
+ */
+static double run_threads(trace_t *parts, int n, worker_t *w,
+			  int tracenum, int libc, int check)
+{
+    pthread_t *tids;
+    pthread_barrier_t start;
+    double begin, end;
+    int t;
+
+    if ((tids = (pthread_t *)malloc(n * sizeof(pthread_t))) == NULL)
+	unix_error("malloc failed in run_threads");
+    pthread_barrier_init(&start, NULL, n + 1);
+    for (t = 0; t < n; t++) {
+	w[t].part = parts[t];
+	w[t].tracenum = tracenum;
+	w[t].libc = libc;
+	w[t].check = check;
+	w[t].valid = 0;
+	w[t].start = &start;
+	if (pthread_create(&tids[t], NULL, replay_thread, &w[t]) != 0)
+	    app_error("pthread_create failed in run_threads");
+    }
+    pthread_barrier_wait(&start);
+    begin = DBL_MAX;
+    end = 0;
+    for (t = 0; t < n; t++) {
+	pthread_join(tids[t], NULL);
+	begin = MIN(begin, w[t].begin);
+	end = MAX(end, w[t].end);
+    }
+    pthread_barrier_destroy(&start);
+    free(tids);
+    return end - begin;
+}
+
+/*
+ * replay_thread - One thread of run_threads: check or time its part
+ */
+static void *replay_thread(void *ptr)
+{
+    worker_t *w = (worker_t *)ptr;
+    range_t *ranges = NULL;
+    speed_t speed;
+
+    pthread_barrier_wait(w->start);
+    w->begin = wall_secs();
+    if (w->check) {
+	w->valid = valid_ops(&w->part, w->tracenum, &ranges, 0);
+	clear_ranges(&ranges);
+	range_flush();
+    }
+    else if (w->libc) {
+	speed.trace = &w->part;
+	eval_libc_speed(&speed);
+    }
+    else
+	speed_ops(&w->part);
+    w->end = wall_secs();
+    return NULL;
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace, int tracenum)
+{
+    long i;
+    int j;
+    size_t newsize;
+    char *p, *newp, *oldp;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[trace->ops[i].index];
+	    if ((newp = realloc(oldp, newsize)) == NULL) {
+		malloc_error(tracenum, i, "libc realloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = newp;
+	    break;
+	    
+        case FREE: /* free */
+        case FREE_SIZED:
+	    free(trace->blocks[trace->ops[i].index]);
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    if (posix_memalign((void **)&p, trace->ops[i].align, 
+			       trace->ops[i].size) != 0) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case ALLOC_BATCH: /* one malloc per block */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+        case FREE_BATCH: /* one free per block */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
+	default:
+	    app_error("invalid operation type  in eval_libc_valid");
+	}
+    }
+
+    return 1;
+}
+
+/* 
+ * eval_libc_speed - This is the function that is used by fcyc() to
+ *    measure the running time of the libc malloc package on the set
+ *    of traces.
+ */
+static void eval_libc_speed(void *ptr)
+{
+    long i, index;
+    int j, count;
+    size_t size, newsize;
+    char *p, *newp, *oldp, *block;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+        case ALLOC: /* malloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = malloc(size)) == NULL)
+		unix_error("malloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
+	    index = trace->ops[i].index;
+	    newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+	    if ((newp = realloc(oldp, newsize)) == NULL)
+		unix_error("realloc failed in eval_libc_speed\n");
+	    
+	    trace->blocks[index] = newp;
+	    break;
+	    
+        case FREE: /* free */
+        case FREE_SIZED:
+	    index = trace->ops[i].index;
+	    block = trace->blocks[index];
+	    free(block);
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if (posix_memalign((void **)&p, trace->ops[i].align, size) != 0)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case ALLOC_BATCH: /* one malloc per block */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++) {
+		if ((p = malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+		trace->blocks[index + j] = p;
+	    }
+	    break;
+
+        case FREE_BATCH: /* one free per block */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++)
+		free(trace->blocks[index + j]);
+	    break;
+	}
+    }
+}
+
+/*
+ * calibrate - Replay the traces on each allocator in spec, a comma
+ *    separated list of "libc", "auto" or lib[:prefix], timed as libc
+ *    malloc is, and score throughput against the fastest of them from
+ *    now on. "auto" is libc and whichever of the libraries in ref_auto
+ *    this host has. A library's functions are found in it alone, under
+ *    its prefix, so that it need not replace libc's malloc to be used.
+ *    Stream traces are left out of the totals.
+ */
+static void calibrate(char *spec, char **tracefiles, int n)
+{
+    ref_t *refs = NULL, *best = NULL, *r;
+    int nrefs = 0, max = 0, i, k, quiet;
+    char *list, *tok, *prefix, path[MAXLINE];
+    trace_t *trace;
+    speed_t speed_params;
+    double secs;
+
+    /* Load the allocators */
+    if ((list = strdup(spec)) == NULL)
+	unix_error("strdup failed in calibrate");
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+	for (k = -1; k < 0 || (!strcmp(tok, "auto") && ref_auto[k][0]); k++) {
+	    if (nrefs + 1 >= max) {
+		max = max ? 2*max : 8;
+		if ((refs = realloc(refs, max * sizeof(ref_t))) == NULL)
+		    unix_error("realloc failed in calibrate");
+	    }
+	    r = &refs[nrefs];
+	    memset(r, 0, sizeof(*r));
+	    quiet = (k >= 0);
+	    if (k < 0 && (!strcmp(tok, "libc") || !strcmp(tok, "auto")))
+		prefix = NULL;
+	    else if (k >= 0) {
+		strcpy(path, ref_auto[k][0]);
+		prefix = ref_auto[k][1];
+	    }
+	    else {
+		strcpy(path, tok);
+		if ((prefix = strchr(path, ':')) != NULL)
+		    *prefix++ = '\0';
+		else
+		    prefix = "";
+	    }
+	    if (prefix == NULL) {
+		strcpy(r->name, "libc");
+		r->malloc = malloc;
+		r->free = free;
+		r->realloc = realloc;
+		r->calloc = calloc;
+		r->memalign = posix_memalign;
+	    }
+	    else if (load_ref(path, prefix, r) < 0) {
+		if (!quiet || verbose > 1)
+		    printf("Could not load allocator %s (%s), skipping it.\n",
+			   path, dlerror());
+		continue;
+	    }
+	    if ((r->kops = (double *)calloc(n, sizeof(double))) == NULL)
+		unix_error("calloc failed in calibrate");
+	    nrefs++;
+	}
+    }
+    free(list);
+    if (nrefs == 0) {
+	printf("No allocator to calibrate against, keeping %.0f Kops.\n",
+	       ref_thruput/1e3);
+	return;
+    }
+
+    /* Time each of them on each trace */
+    for (i = 0; i < n; i++) {
+	sprintf(path, "%s%s", tracedir, tracefiles[i]);
+	if (stream_probe(path))
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	for (k = 0; k < nrefs; k++) {
+	    r = &refs[k];
+	    speed_params.ref = r;
+	    secs = fsecs(eval_ref_speed, &speed_params);
+	    r->kops[i] = (secs > 0) ? (trace->num_objs/1e3)/secs : 0;
+	    r->ops += trace->num_objs;
+	    r->secs += secs;
+	}
+	free_trace(trace);
+    }
+
+    printf("\nThroughput of the allocators on this host:\n");
+    printf("%-32s%10s%10s%8s\n", "allocator", "ops", "secs", "Kops");
+    for (k = 0; k < nrefs; k++) {
+	r = &refs[k];
+	printf("%-32s%10.0f%10.6f%8.0f\n", r->name, r->ops, r->secs,
+	       (r->ops/1e3)/r->secs);
+	if (best == NULL || r->ops/r->secs > best->ops/best->secs)
+	    best = r;
+    }
+    if (verbose) {
+	printf("\nKops per trace:\n%5s", "trace");
+	for (k = 0; k < nrefs; k++)
+	    printf("%12.11s", refs[k].name);
+	printf("\n");
+	for (i = 0; i < n; i++) {
+	    printf("%2d   ", i);
+	    for (k = 0; k < nrefs; k++)
+		if (refs[k].kops[i] > 0)
+		    printf("%12.0f", refs[k].kops[i]);
+		else
+		    printf("%12s", "-");
+	    printf("\n");
+	}
+    }
+    printf("Scoring throughput against %s.\n", best->name);
+
+    ref_thruput = best->ops/best->secs;
+    ref_name = strdup(best->name);
+    for (k = 0; k < nrefs; k++)
+	free(refs[k].kops);
+    free(refs);
+}
+
+/*
+ * load_ref - Open the shared library lib and find its malloc, free,
+ *    realloc, calloc and posix_memalign under prefix. Returns -1, with
+ *    the reason in dlerror, if it is missing any of them.
+ */
+static int load_ref(char *lib, char *prefix, ref_t *ref)
+{
+    void *handle;
+    char sym[MAXLINE];
+
+    if ((handle = dlopen(lib, RTLD_NOW | RTLD_LOCAL)) == NULL)
+	return -1;
+#define REF_SYM(field, fn) \
+    sprintf(sym, "%s%s", prefix, fn); \
+    if ((*(void **)&ref->field = dlsym(handle, sym)) == NULL) \
+	return -1
+    REF_SYM(malloc, "malloc");
+    REF_SYM(free, "free");
+    REF_SYM(realloc, "realloc");
+    REF_SYM(calloc, "calloc");
+    REF_SYM(memalign, "posix_memalign");
+#undef REF_SYM
+    if (*prefix)
+	sprintf(ref->name, "%s (%s*)", lib, prefix);
+    else
+	strcpy(ref->name, lib);
+    return 0;
+}
+
+/*
+ * eval_ref_speed - The function fsecs times for a calibration replay:
+ *    eval_libc_speed, on the allocator of ptr's ref
+ */
+static void eval_ref_speed(void *ptr)
+{
+    long i, index;
+    int j, count;
+    size_t size;
+    char *p;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    ref_t *ref = ((speed_t *)ptr)->ref;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC: /* malloc */
+	    if ((p = ref->malloc(size)) == NULL)
+		unix_error("malloc failed in eval_ref_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
+	    if ((p = ref->realloc(trace->blocks[index], size)) == NULL)
+		unix_error("realloc failed in eval_ref_speed");
+	    trace->blocks[index] = p;
+	    break;
+	    
+        case FREE: /* free */
+        case FREE_SIZED:
+	    ref->free(trace->blocks[index]);
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    if (ref->memalign((void **)&p, trace->ops[i].align, size) != 0)
+		unix_error("posix_memalign failed in eval_ref_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = ref->calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_ref_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case ALLOC_BATCH: /* one malloc per block */
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++) {
+		if ((p = ref->malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_ref_speed");
+		trace->blocks[index + j] = p;
+	    }
+	    break;
+
+        case FREE_BATCH: /* one free per block */
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++)
+		ref->free(trace->blocks[index + j]);
+	    break;
+	}
+    }
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+
+/*
+ * fit_heap - Grow the simulated heap to a trace's suggested heap size,
+ *     which most traces set well below the default. Only the pages the
+ *     allocator touches are ever backed by memory.
+ */
+static void fit_heap(size_t sugg_heapsize)
+{
+    if (sugg_heapsize > mem_max_heap()) {
+	if (verbose > 1)
+	    printf("Growing the heap to %zu bytes\n", sugg_heapsize);
+	mem_set_max_heap(sugg_heapsize);
+    }
+}
+
+/*
+ * wall_secs - Seconds on a clock that only ever moves forward
+ */
+static double wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * thread_secs - CPU time used so far by the calling thread, in seconds
+ */
+static double thread_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * printresults - prints a performance summary for some malloc package
  */
 static void printresults(int n, stats_t *stats) 
 {
@@ -986,6 +3823,1110 @@ static void printresults(int n, stats_t *stats)
 	       "-");
     }
 
+    /* Latency percentiles, when they were measured */
+    if (n > 0 && stats[0].lat != NULL)
+	printlatency(n, stats);
+
+    /* The repeated runs */
+    if (reps > 0)
+	printruns(n, stats);
+
+    /* The fragmentation timelines */
+    if (tl_every > 0)
+	printtimeline(n, stats);
+
+    /* The replays that use their blocks */
+    if (touch_every > 0)
+	printtouch(n, stats);
+
+#if MM_PROFILE
+    /* How mm placed its blocks */
+    printprofile(n, stats);
+#endif
+
+#if MM_PHASES
+    /* And where its time went */
+    printphases(n, stats);
+#endif
+
+#if MM_CACHESIM
+    /* Its simulated cache misses */
+    printcachesim(n, stats);
+#endif
+
+    /* The hardware counts */
+    if (counters)
+	printcounters(n, stats);
+
+    /* And the threaded replays */
+    if (nthreads > 0)
+	printscaling(n, stats);
+}
+
+/*
+ * printlatency - prints the latency percentiles of each request type
+ *     that occurs in each trace, in cycles
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i, t;
+    hist_t *h;
+
+    printf("\nLatency in cycles (%llu cycles of timer overhead removed):\n",
+	   tsc_ovhd);
+    printf("%5s %-12s%9s%8s%8s%8s%8s%10s\n", 
+	   "trace", "request", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].lat == NULL)
+	    continue;
+	for (t = 0; t < NREQTYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->total == 0)
+		continue;
+	    printf("%2d    %-12s%9llu%8llu%8llu%8llu%8llu%10llu\n", 
+		   i,
+		   reqnames[t],
+		   h->total,
+		   hist_percentile(h, 50.0),
+		   hist_percentile(h, 90.0),
+		   hist_percentile(h, 99.0),
+		   hist_percentile(h, 99.9),
+		   h->max);
+	}
+    }
+}
+
+/*
+ * printscaling - prints the throughput of each trace replayed in 1 to
+ *     nthreads threads: overall, as a speedup over the same parts
+ *     replayed one after another, as that speedup's share of the
+ *     thread count, and for each thread
+ */
+static void printscaling(int n, stats_t *stats)
+{
+    int i, k, t;
+    double speedup;
+    scale_t *sc;
+
+    printf("\nThreaded replay in 1 to %d threads:\n", nthreads);
+    printf("%5s%8s%10s%10s%8s%8s%6s  %s\n", 
+	   "trace", "threads", "serial", "secs", "Kops", "speedup", "eff",
+	   "Kops/thread");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || (sc = stats[i].scale) == NULL)
+	    continue;
+	for (k = 1; k <= nthreads; k++) {
+	    if (sc[k-1].kops == NULL)
+		continue;
+	    speedup = sc[k-1].serial/sc[k-1].secs;
+	    printf("%2d%11d%10.6f%10.6f%8.0f%8.2f%5.0f%% ", 
+		   i,
+		   k,
+		   sc[k-1].serial,
+		   sc[k-1].secs,
+		   (stats[i].ops/1e3)/sc[k-1].secs,
+		   speedup,
+		   speedup/k*100.0);
+	    for (t = 0; t < k; t++)
+		printf(" %.0f", sc[k-1].kops[t]);
+	    printf("\n");
+	}
+    }
+}
+
+/*
+ * printruns - prints the median throughput of each trace's repeated
+ *     runs and its 95% confidence interval, also as a share of the
+ *     median, with how many runs were left once outliers were dropped
+ */
+static void printruns(int n, stats_t *stats)
+{
+    int i;
+    bench_t *b;
+
+    printf("\nThroughput of %d timed runs per trace:\n", reps);
+    printf("%5s%6s%6s%10s%22s%8s\n", 
+	   "trace", "runs", "kept", "Kops", "95% CI", "+/-");
+    for (i=0; i < n; i++) {
+	b = &stats[i].runs;
+	if (!stats[i].valid || b->runs == 0)
+	    continue;
+	printf("%2d%9d%6d%10.0f  [%8.0f, %8.0f]%7.1f%%\n", 
+	       i,
+	       b->runs,
+	       b->kept,
+	       b->median,
+	       b->lo,
+	       b->hi,
+	       (b->hi - b->lo) / 2 / b->median * 100.0);
+    }
+}
+
+/*
+ * printtimeline - prints each trace's peak util beside its util averaged
+ *     over the ops of its timeline, and its external and internal
+ *     fragmentation, also averaged over ops
+ */
+static void printtimeline(int n, stats_t *stats)
+{
+    int i;
+    timeline_t *tl;
+
+    for (i=0; i < n && stats[i].tl.samples == 0; i++)
+	;
+    if (i == n)  /* not run for this package */
+	return;
+    printf("\nFragmentation sampled every %ld ops:\n", tl_every);
+    printf("%5s%9s%6s%8s%9s%9s%9s\n", 
+	   "trace", "samples", "util", "tw-util", "ext avg", "ext max", 
+	   "int avg");
+    for (i=0; i < n; i++) {
+	tl = &stats[i].tl;
+	if (!stats[i].valid || tl->samples == 0)
+	    continue;
+	printf("%2d%12ld%5.0f%%%7.0f%%%8.1f%%%8.1f%%%8.1f%%\n", 
+	       i,
+	       tl->samples,
+	       stats[i].util*100.0,
+	       tl->twutil*100.0,
+	       tl->ext_avg*100.0,
+	       tl->ext_max*100.0,
+	       tl->int_avg*100.0);
+    }
+}
+
+/*
+ * printtouch - prints the time of each trace's touch replay beside its
+ *     plain one, and the cache and TLB misses per op of the touch
+ *     replay. A "-" is a counter this machine does not have.
+ */
+static void printtouch(int n, stats_t *stats)
+{
+    static int ctr[] = {PERFCTR_L1D_MISS, PERFCTR_LLC_MISS, 
+			PERFCTR_DTLB_MISS};
+    int i, k;
+    touch_t *t;
+
+    printf("\nPayloads written and swept every %ld ops, %s:\n", 
+	   touch_every, touch_random ? "in random order" : 
+	   "in allocation order");
+    printf("%5s%8s%10s%8s%7s", "trace", "sweeps", "secs", "Kops", "slow");
+    for (k = 0; k < 3; k++)
+	printf("%10s", perfctr_name(ctr[k]));
+    printf("  (misses per op)\n");
+    for (i=0; i < n; i++) {
+	t = &stats[i].touch;
+	if (!stats[i].valid || t->secs == 0)
+	    continue;
+	printf("%2d%11ld%10.6f%8.0f%6.1fx", 
+	       i,
+	       t->sweeps,
+	       t->secs,
+	       (stats[i].ops/1e3)/t->secs,
+	       t->secs/stats[i].secs);
+	for (k = 0; k < 3; k++) {
+	    if (t->ctrs.count[ctr[k]] < 0)
+		printf("%10s", "-");
+	    else
+		printf("%10.2f", t->ctrs.count[ctr[k]] / stats[i].ops);
+	}
+	printf("\n");
+    }
+}
+
+#if MM_PROFILE
+/*
+ * printprofile - prints how the fit searches of each trace's util replay
+ *     went: the free blocks they examined, how their blocks were placed,
+ *     and the bytes split off and padded on. With -V, also the
+ *     histograms of candidates examined and remainders per search.
+ */
+static void printprofile(int n, stats_t *stats)
+{
+    int i, k;
+    mm_prof_t *p;
+
+    for (i=0; i < n && stats[i].prof.searches == 0; i++)
+	;
+    if (i == n)  /* not run for this package */
+	return;
+    printf("\nFit searches of mm_malloc:\n");
+    printf("%5s%9s%8s%8s%7s%7s%7s%10s%9s\n", 
+	   "trace", "searches", "avg", "max", "exact", "split", "extend",
+	   "remainder", "padding");
+    for (i=0; i < n; i++) {
+	p = &stats[i].prof;
+	if (!stats[i].valid || p->searches == 0)
+	    continue;
+	printf("%2d%12lu%8.1f%8lu%6.0f%%%6.0f%%%6.0f%%%10.0f%9.1f\n", 
+	       i,
+	       p->searches,
+	       (double)p->candidates / p->searches,
+	       p->max_candidates,
+	       100.0 * p->exact / p->searches,
+	       100.0 * p->split / p->searches,
+	       100.0 * p->extend / p->searches,
+	       (double)p->remainder / p->searches,
+	       (double)p->padding / p->searches);
+    }
+    if (verbose < 2)
+	return;
+
+    printf("\nCandidates examined and remainder bytes per search, by "
+	   "power of 2:\n");
+    for (i=0; i < n; i++) {
+	p = &stats[i].prof;
+	if (!stats[i].valid || p->searches == 0)
+	    continue;
+	printf("%2d  candidates", i);
+	for (k = 0; k < MM_PROF_BUCKETS; k++)
+	    if (p->search_hist[k] != 0)
+		printf(" <%lu:%lu", 1UL << k, p->search_hist[k]);
+	printf("\n    remainder ");
+	for (k = 0; k < MM_PROF_BUCKETS; k++)
+	    if (p->remainder_hist[k] != 0)
+		printf(" <%lu:%lu", 1UL << k, p->remainder_hist[k]);
+	printf("\n");
+    }
+}
+#endif
+
+#if MM_PHASES
+/*
+ * printphases - prints the cycles per op of each trace's timed replay,
+ *     and the share of them spent in each phase of mm. The rest is the
+ *     driver and the parts of mm outside the phases.
+ */
+static void printphases(int n, stats_t *stats)
+{
+    int i, k;
+    double rest;
+
+    for (i=0; i < n && stats[i].phase_ticks == 0; i++)
+	;
+    if (i == n)  /* not run for this package */
+	return;
+    printf("\nTime in the phases of mm, as a share of one timed replay:\n");
+    printf("%5s%9s", "trace", "cyc/op");
+    for (k = 0; k < MM_NPHASES; k++)
+	printf("%9s", mm_phase_name(k));
+    printf("%9s\n", "other");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].phase_ticks == 0)
+	    continue;
+	printf("%2d%12.1f", i, stats[i].phase_ticks / stats[i].ops);
+	rest = stats[i].phase_ticks;
+	for (k = 0; k < MM_NPHASES; k++) {
+	    printf("%8.1f%%", 100.0 * stats[i].phases.ticks[k] / 
+		   stats[i].phase_ticks);
+	    rest -= stats[i].phases.ticks[k];
+	}
+	printf("%8.1f%%\n", 100.0 * rest / stats[i].phase_ticks);
+    }
+}
+#endif
+
+#if MM_CACHESIM
+/*
+ * printcachesim - prints the cache lines mm touched in one replay of
+ *     each trace and how many of them missed in each simulated level,
+ *     in all and per op
+ */
+static void printcachesim(int n, stats_t *stats)
+{
+    int i, k;
+    cachesim_counts_t *c;
+
+    for (i=0; i < n && stats[i].sim.accesses == 0; i++)
+	;
+    if (i == n)  /* not run for this package */
+	return;
+    printf("\nSimulated cache misses of mm (L1 %s, ", cachesim_level(0));
+    printf("L2 %s, ", cachesim_level(1));
+    printf("LLC %s, %dB lines):\n", cachesim_level(2), CACHESIM_LINE);
+    printf("%5s%11s", "trace", "lines");
+    for (k = 0; k < CACHESIM_LEVELS; k++)
+	printf("%10s", cachesim_name(k));
+    printf("%9s", "lines/op");
+    for (k = 0; k < CACHESIM_LEVELS; k++)
+	printf("%5s/op", cachesim_name(k));
+    printf("\n");
+    for (i=0; i < n; i++) {
+	c = &stats[i].sim;
+	if (!stats[i].valid || c->accesses == 0)
+	    continue;
+	printf("%2d%14llu", i, c->accesses);
+	for (k = 0; k < CACHESIM_LEVELS; k++)
+	    printf("%10llu", c->misses[k]);
+	printf("%9.2f", c->accesses / stats[i].ops);
+	for (k = 0; k < CACHESIM_LEVELS; k++)
+	    printf("%8.2f", c->misses[k] / stats[i].ops);
+	printf("\n");
+    }
+}
+#endif
+
+/*
+ * printcounters - prints the hardware counts of each trace's timed
+ *     replay, and the same divided by its number of ops. A "-" is a
+ *     counter this machine does not have.
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, k, per_op;
+    double c;
+
+    for (per_op = 0; per_op <= 1; per_op++) {
+	printf(per_op ? "\nHardware counts per op:\n" : 
+	       "\nHardware counts per trace:\n");
+	printf("%5s", "trace");
+	for (k = 0; k < PERFCTR_N; k++)
+	    printf("%11s", perfctr_name(k));
+	if (per_op)
+	    printf("%7s", "IPC");
+	printf("\n");
+	for (i=0; i < n; i++) {
+	    for (k = 0; k < PERFCTR_N && stats[i].ctrs.count[k] < 0; k++)
+		;
+	    if (!stats[i].valid || k == PERFCTR_N)  /* nothing counted */
+		continue;
+	    printf("%2d   ", i);
+	    for (k = 0; k < PERFCTR_N; k++) {
+		if ((c = stats[i].ctrs.count[k]) < 0)
+		    printf("%11s", "-");
+		else if (per_op)
+		    printf("%11.2f", c / stats[i].ops);
+		else
+		    printf("%11.0f", c);
+	    }
+	    if (per_op) {
+		if (stats[i].ctrs.count[PERFCTR_CYCLES] > 0 &&
+		    stats[i].ctrs.count[PERFCTR_INSTR] >= 0)
+		    printf("%7.2f", stats[i].ctrs.count[PERFCTR_INSTR] / 
+			   stats[i].ctrs.count[PERFCTR_CYCLES]);
+		else
+		    printf("%7s", "-");
+	    }
+	    printf("\n");
+	}
+    }
+}
+
+/*
+ * save_results - Write each trace's stats to path: its util, ops and
+ *     secs, the summary of its repeated runs, its latency percentiles,
+ *     its hardware counts and its simulated misses, each on a line that
+ *     names the trace
+ */
+static void save_results(char *path, char **tracefiles, int n, 
+			 stats_t *stats)
+{
+    FILE *fp;
+    bench_t *b;
+    hist_t *h;
+    int i, t, k;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s for writing", path);
+	unix_error(msg);
+    }
+    fprintf(fp, "%s\n", RESULTS_MAGIC);
+    fprintf(fp, "# trace <name> <valid> <util> <ops> <secs> "
+	    "<runs> <kept> <median> <lo> <hi> <mean> <sd>\n");
+    fprintf(fp, "# lat <name> <request> <count> <p50> <p90> <p99> "
+	    "<p99.9> <max>\n");
+    fprintf(fp, "# ctr <name> <counter> <count>\n");
+#if MM_CACHESIM
+    fprintf(fp, "# sim <name> <lines> <L1> <L2> <LLC> (L1 %s, ", 
+	    cachesim_level(0));
+    fprintf(fp, "L2 %s, ", cachesim_level(1));
+    fprintf(fp, "LLC %s)\n", cachesim_level(2));
+#endif
+    for (i=0; i < n; i++) {
+	b = &stats[i].runs;
+	fprintf(fp, "trace %s %d %.17g %.0f %.17g %d %d %.3f %.3f %.3f "
+		"%.3f %.3f\n",
+		tracefiles[i], stats[i].valid, stats[i].util, stats[i].ops,
+		stats[i].secs, b->runs, b->kept, b->median, b->lo, b->hi,
+		b->mean, b->sd);
+	for (t = 0; stats[i].lat != NULL && t < NREQTYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->total == 0)
+		continue;
+	    fprintf(fp, "lat %s %s %llu %llu %llu %llu %llu %llu\n",
+		    tracefiles[i], reqnames[t], h->total,
+		    hist_percentile(h, 50.0), hist_percentile(h, 90.0),
+		    hist_percentile(h, 99.0), hist_percentile(h, 99.9),
+		    h->max);
+	}
+	for (k = 0; counters && k < PERFCTR_N; k++)
+	    if (stats[i].ctrs.count[k] >= 0)
+		fprintf(fp, "ctr %s %s %.0f\n", tracefiles[i],
+			perfctr_name(k), stats[i].ctrs.count[k]);
+#if MM_CACHESIM
+	if (stats[i].sim.accesses > 0)
+	    fprintf(fp, "sim %s %llu %llu %llu %llu\n", tracefiles[i],
+		    stats[i].sim.accesses, stats[i].sim.misses[0],
+		    stats[i].sim.misses[1], stats[i].sim.misses[2]);
+#endif
+    }
+    if (fclose(fp) != 0) {
+	sprintf(msg, "Could not write %s", path);
+	unix_error(msg);
+    }
+}
+
+/*
+ * read_results - Read the trace lines of the results file at path into
+ *     an array, and its length into *n, with the simulated misses from
+ *     the sim line that follows a trace's line. The other lines are
+ *     for people.
+ */
+static baseline_t *read_results(char *path, int *n)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    baseline_t *base = NULL, *r;
+    int max = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open baseline %s", path);
+	unix_error(msg);
+    }
+    if (fgets(line, MAXLINE, fp) == NULL || 
+	strncmp(line, RESULTS_MAGIC, strlen(RESULTS_MAGIC)) != 0) {
+	sprintf(msg, "%s is not an mdriver results file", path);
+	app_error(msg);
+    }
+    *n = 0;
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if (strncmp(line, "sim ", 4) == 0 && *n > 0) {
+	    r = &base[*n - 1];
+	    if (sscanf(line, "sim %*s %llu %llu %llu %llu", &r->sim.accesses,
+		       &r->sim.misses[0], &r->sim.misses[1], 
+		       &r->sim.misses[2]) != 4) {
+		printf("Bad sim line in %s: %s", path, line);
+		exit(1);
+	    }
+	    continue;
+	}
+	if (strncmp(line, "trace ", 6) != 0)
+	    continue;
+	if (*n == max) {
+	    max = max ? 2*max : 16;
+	    if ((base = realloc(base, max * sizeof(baseline_t))) == NULL)
+		unix_error("realloc failed in read_results");
+	}
+	r = &base[*n];
+	memset(r, 0, sizeof(*r));
+	if (sscanf(line, "trace %1023s %d %lf %lf %lf %d %d %lf %lf %lf "
+		   "%lf %lf", r->name, &r->valid, &r->util, &r->ops, 
+		   &r->secs, &r->runs.runs, &r->runs.kept, &r->runs.median,
+		   &r->runs.lo, &r->runs.hi, &r->runs.mean, 
+		   &r->runs.sd) != 12) {
+	    printf("Bad trace line in %s: %s", path, line);
+	    exit(1);
+	}
+	(*n)++;
+    }
+    fclose(fp);
+    return base;
+}
+
+/*
+ * compare_results - prints each trace's util and throughput beside the
+ *     baseline's, and returns how many traces regressed. A trace
+ *     regresses if it was valid and is not, if its util dropped more
+ *     than util_slack points, or if its throughput dropped more than
+ *     thru_slack percent. When both sides have repeated runs (-r),
+ *     throughput is their median, and a drop only counts if Welch's
+ *     t-test finds it significant at REGRESS_ALPHA. With MM_CACHESIM,
+ *     a trace also regresses if it misses more often in any simulated
+ *     level than the baseline did; the simulation is exact, so no rise
+ *     is noise.
+ */
+static int compare_results(char *path, char **tracefiles, int n, 
+			   stats_t *stats)
+{
+    baseline_t *base, *r;
+    int nbase, i, j, bad, regressions = 0;
+    double kops0, kops1, dutil, dkops, p;
+#if MM_CACHESIM
+    int k;
+#endif
+
+    base = read_results(path, &nbase);
+    printf("\nCompared with baseline %s (fails on util -%.1f pts, "
+	   "Kops -%.1f%%):\n", path, util_slack, thru_slack);
+    printf("%5s%7s%7s%7s%9s%9s%8s%8s  %s\n", 
+	   "trace", "util0", "util", "delta", "Kops0", "Kops", "delta", "p",
+	   "verdict");
+    for (i=0; i < n; i++) {
+	for (j = 0, r = NULL; j < nbase && r == NULL; j++)
+	    if (!strcmp(base[j].name, tracefiles[i]))
+		r = &base[j];
+	if (r == NULL || !r->valid) {
+	    printf("%2d%54s  %s\n", i, "", 
+		   (r == NULL) ? "not in baseline" : "was invalid");
+	    continue;
+	}
+	if (!stats[i].valid) {
+	    printf("%2d%54s  %s\n", i, "", "REGRESSED: now invalid");
+	    regressions++;
+	    continue;
+	}
+
+	/* Throughput from the repeated runs if both sides have them */
+	p = -1;
+	if (r->runs.kept > 0 && stats[i].runs.kept > 0) {
+	    kops0 = r->runs.median;
+	    kops1 = stats[i].runs.median;
+	    p = bench_pvalue(&r->runs, &stats[i].runs);
+	}
+	else {
+	    kops0 = (r->ops/1e3)/r->secs;
+	    kops1 = (stats[i].ops/1e3)/stats[i].secs;
+	}
+	dutil = (stats[i].util - r->util) * 100.0;
+	dkops = (kops1 - kops0) / kops0 * 100.0;
+
+	bad = (dutil < -util_slack) || 
+	    (dkops < -thru_slack && (p < 0 || p < REGRESS_ALPHA));
+#if MM_CACHESIM
+	bad = bad || sim_worse(&r->sim, &stats[i].sim);
+#endif
+	regressions += bad;
+	printf("%2d%9.0f%%%6.0f%%%7.1f%9.0f%9.0f%7.1f%%", 
+	       i, r->util*100.0, stats[i].util*100.0, dutil, kops0, kops1, 
+	       dkops);
+	if (p >= 0)
+	    printf("%8.3f", p);
+	else
+	    printf("%8s", "-");
+	printf("  %s\n", bad ? "REGRESSED" : "ok");
+    }
+
+#if MM_CACHESIM
+    /* The simulated misses behind the verdicts */
+    printf("\nSimulated cache misses against the baseline:\n");
+    printf("%5s", "trace");
+    for (k = 0; k < CACHESIM_LEVELS; k++)
+	printf("%7s was%11s%9s", cachesim_name(k), cachesim_name(k), "delta");
+    printf("\n");
+    for (i=0; i < n; i++) {
+	for (j = 0, r = NULL; j < nbase && r == NULL; j++)
+	    if (!strcmp(base[j].name, tracefiles[i]))
+		r = &base[j];
+	if (r == NULL || r->sim.accesses == 0 || !stats[i].valid ||
+	    stats[i].sim.accesses == 0)
+	    continue;
+	printf("%2d   ", i);
+	for (k = 0; k < CACHESIM_LEVELS; k++) {
+	    printf("%11llu%11llu", r->sim.misses[k], stats[i].sim.misses[k]);
+	    if (r->sim.misses[k] > 0)
+		printf("%8.1f%%", ((double)stats[i].sim.misses[k] - 
+				   r->sim.misses[k]) / r->sim.misses[k] * 100);
+	    else
+		printf("%9s", "-");
+	}
+	printf("  %s\n", sim_worse(&r->sim, &stats[i].sim) ? 
+	       "more misses" : "ok");
+    }
+#endif
+    free(base);
+    return regressions;
+}
+
+#if MM_CACHESIM
+/*
+ * sim_worse - Did any simulated level miss more in now than in base?
+ *     Counts that were not taken on either side are never worse.
+ */
+static int sim_worse(cachesim_counts_t *base, cachesim_counts_t *now)
+{
+    int k;
+
+    if (base->accesses == 0 || now->accesses == 0)
+	return 0;
+    for (k = 0; k < CACHESIM_LEVELS; k++)
+	if (now->misses[k] > base->misses[k])
+	    return 1;
+    return 0;
+}
+#endif
+
+/*
+ * get_host - Describe the machine: its uname, CPU model from
+ *     /proc/cpuinfo, CPU count, governor, and the time
+ */
+static void get_host(host_t *host)
+{
+    FILE *fp;
+    char line[MAXLINE], *p;
+    time_t now = time(NULL);
+    int cpu;
+
+    memset(host, 0, sizeof(*host));
+    uname(&host->uts);
+    strcpy(host->cpu, host->uts.machine);
+    if ((fp = fopen("/proc/cpuinfo", "r")) != NULL) {
+	while (fgets(line, MAXLINE, fp) != NULL) {
+	    if (strncmp(line, "model name", 10) != 0 || 
+		(p = strchr(line, ':')) == NULL)
+		continue;
+	    for (p++; *p == ' ' || *p == '\t'; p++)
+		;
+	    p[strcspn(p, "\n")] = '\0';
+	    strcpy(host->cpu, p);
+	    break;
+	}
+	fclose(fp);
+    }
+    host->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu = sched_getcpu();
+    host->governor = (cpu >= 0) ? bench_governor(cpu) : NULL;
+    strftime(host->time, sizeof(host->time), "%Y-%m-%dT%H:%M:%SZ", 
+	     gmtime(&now));
+}
+
+/*
+ * json_string - prints str as a JSON string
+ */
+static void json_string(FILE *fp, char *str)
+{
+    fputc('"', fp);
+    for (; *str; str++) {
+	if (*str == '"' || *str == '\\')
+	    fprintf(fp, "\\%c", *str);
+	else if ((unsigned char)*str < 0x20)
+	    fprintf(fp, "\\u%04x", *str);
+	else
+	    fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * printjson - prints the whole run as one JSON object: the config and
+ *     host, each trace's stats with its libc counterpart, and the totals
+ *     of the performance index. Stats a mode did not measure are left
+ *     out, and counters the machine lacks are null.
+ */
+static void printjson(FILE *fp, char **tracefiles, int n, stats_t *stats,
+		      stats_t *libc_stats, summary_t *sum)
+{
+    host_t host;
+    stats_t *st, *lc;
+    bench_t *b;
+    hist_t *h;
+    scale_t *sc;
+    double libc_ops = 0, libc_secs = 0;
+    int i, j, k, t;
+
+    get_host(&host);
+    fprintf(fp, "{\n  \"config\": {\"timer\": \"%s\", \"alignment\": %d, "
+	    "\"max_heap\": %lu, \"heap_limit\": %lu, \"util_weight\": %g, "
+	    "\"avg_libc_thruput\": %g, \"thru_ref\": ",
+	    fsecs_timer(), ALIGNMENT, (unsigned long)MAX_HEAP, 
+	    (unsigned long)mem_max_heap(), UTIL_WEIGHT, AVG_LIBC_THRUPUT);
+    if (ref_name != NULL)
+	json_string(fp, ref_name);
+    else
+	fprintf(fp, "null");
+    fprintf(fp, ", \"thru_target\": %g, \"thru_capped\": %s, \"runs\": %d, "
+	    "\"threads\": %d, \"procs\": %d, \"latency\": %s, "
+	    "\"counters\": %s},\n", ref_thruput, thru_cap ? "true" : "false",
+	    reps, nthreads, nprocs, latency ? "true" : "false", 
+	    counters ? "true" : "false");
+    fprintf(fp, "  \"host\": {\"name\": ");
+    json_string(fp, host.uts.nodename);
+    fprintf(fp, ", \"os\": ");
+    json_string(fp, host.uts.sysname);
+    fprintf(fp, ", \"release\": ");
+    json_string(fp, host.uts.release);
+    fprintf(fp, ", \"machine\": ");
+    json_string(fp, host.uts.machine);
+    fprintf(fp, ", \"cpu\": ");
+    json_string(fp, host.cpu);
+    fprintf(fp, ", \"cpus\": %ld, \"governor\": ", host.cpus);
+    if (host.governor != NULL)
+	json_string(fp, host.governor);
+    else
+	fprintf(fp, "null");
+    fprintf(fp, ", \"compiler\": ");
+    json_string(fp, __VERSION__);
+    fprintf(fp, ", \"time\": \"%s\"},\n", host.time);
+
+    fprintf(fp, "  \"traces\": [");
+    for (i=0; i < n; i++) {
+	st = &stats[i];
+	fprintf(fp, "%s\n    {\"trace\": %d, \"name\": ", i ? "," : "", i);
+	json_string(fp, tracefiles[i]);
+	fprintf(fp, ", \"valid\": %s", st->valid ? "true" : "false");
+	if (st->valid)
+	    fprintf(fp, ", \"util\": %.6g, \"ops\": %.0f, \"secs\": %.9g, "
+		    "\"kops\": %.6g", st->util, st->ops, st->secs, 
+		    (st->ops/1e3)/st->secs);
+	b = &st->runs;
+	if (st->valid && b->runs > 0)
+	    fprintf(fp, ",\n     \"runs\": {\"runs\": %d, \"kept\": %d, "
+		    "\"median\": %.6g, \"lo\": %.6g, \"hi\": %.6g, "
+		    "\"mean\": %.6g, \"sd\": %.6g}",
+		    b->runs, b->kept, b->median, b->lo, b->hi, b->mean, b->sd);
+	if (st->valid && st->tl.samples > 0)
+	    fprintf(fp, ",\n     \"timeline\": {\"samples\": %ld, "
+		    "\"tw_util\": %.6g, \"ext_avg\": %.6g, \"ext_max\": %.6g, "
+		    "\"int_avg\": %.6g}", st->tl.samples, st->tl.twutil, 
+		    st->tl.ext_avg, st->tl.ext_max, st->tl.int_avg);
+	if (st->valid && st->touch.secs > 0) {
+	    fprintf(fp, ",\n     \"touch\": {\"every\": %ld, \"random\": %s, "
+		    "\"sweeps\": %ld, \"secs\": %.9g, \"kops\": %.6g",
+		    touch_every, touch_random ? "true" : "false", 
+		    st->touch.sweeps, st->touch.secs, 
+		    (st->ops/1e3)/st->touch.secs);
+	    for (k = 0; k < PERFCTR_N; k++) {
+		fprintf(fp, ", \"%s\": ", perfctr_name(k));
+		if (st->touch.ctrs.count[k] < 0)
+		    fprintf(fp, "null");
+		else
+		    fprintf(fp, "%.0f", st->touch.ctrs.count[k]);
+	    }
+	    fprintf(fp, "}");
+	}
+#if MM_PROFILE
+	if (st->valid && st->prof.searches > 0) {
+	    fprintf(fp, ",\n     \"profile\": {\"searches\": %lu, "
+		    "\"candidates\": %lu, \"max_candidates\": %lu, "
+		    "\"exact\": %lu, \"split\": %lu, \"extend\": %lu, "
+		    "\"remainder\": %lu, \"padding\": %lu, \"search_hist\": [",
+		    st->prof.searches, st->prof.candidates, 
+		    st->prof.max_candidates, st->prof.exact, st->prof.split,
+		    st->prof.extend, st->prof.remainder, st->prof.padding);
+	    for (k = 0; k < MM_PROF_BUCKETS; k++)
+		fprintf(fp, "%s%lu", k ? ", " : "", st->prof.search_hist[k]);
+	    fprintf(fp, "], \"remainder_hist\": [");
+	    for (k = 0; k < MM_PROF_BUCKETS; k++)
+		fprintf(fp, "%s%lu", k ? ", " : "", st->prof.remainder_hist[k]);
+	    fprintf(fp, "]}");
+	}
+#endif
+#if MM_PHASES
+	if (st->valid && st->phase_ticks > 0) {
+	    fprintf(fp, ",\n     \"phases\": {\"ticks\": %llu", 
+		    st->phase_ticks);
+	    for (k = 0; k < MM_NPHASES; k++)
+		fprintf(fp, ", \"%s\": {\"ticks\": %llu, \"calls\": %llu}",
+			mm_phase_name(k), st->phases.ticks[k], 
+			st->phases.calls[k]);
+	    fprintf(fp, "}");
+	}
+#endif
+#if MM_CACHESIM
+	if (st->valid && st->sim.accesses > 0) {
+	    fprintf(fp, ",\n     \"cachesim\": {\"lines\": %llu", 
+		    st->sim.accesses);
+	    for (k = 0; k < CACHESIM_LEVELS; k++)
+		fprintf(fp, ", \"%s_misses\": %llu", cachesim_name(k),
+			st->sim.misses[k]);
+	    fprintf(fp, "}");
+	}
+#endif
+	if (st->valid && st->lat != NULL) {
+	    fprintf(fp, ",\n     \"latency\": {");
+	    for (t = k = 0; t < NREQTYPES; t++) {
+		h = &st->lat[t];
+		if (h->total == 0)
+		    continue;
+		fprintf(fp, "%s\"%s\": {\"count\": %llu, \"p50\": %llu, "
+			"\"p90\": %llu, \"p99\": %llu, \"p99.9\": %llu, "
+			"\"max\": %llu}", k++ ? ", " : "", reqnames[t], 
+			h->total, hist_percentile(h, 50.0), 
+			hist_percentile(h, 90.0), hist_percentile(h, 99.0),
+			hist_percentile(h, 99.9), h->max);
+	    }
+	    fprintf(fp, "}");
+	}
+	if (st->valid && counters) {
+	    fprintf(fp, ",\n     \"counters\": {");
+	    for (k = 0; k < PERFCTR_N; k++) {
+		fprintf(fp, "%s\"%s\": ", k ? ", " : "", perfctr_name(k));
+		if (st->ctrs.count[k] < 0)
+		    fprintf(fp, "null");
+		else
+		    fprintf(fp, "%.0f", st->ctrs.count[k]);
+	    }
+	    fprintf(fp, "}");
+	}
+	if (st->valid && (sc = st->scale) != NULL) {
+	    fprintf(fp, ",\n     \"scaling\": [");
+	    for (k = 1, t = 0; k <= nthreads; k++) {
+		if (sc[k-1].kops == NULL)
+		    continue;
+		fprintf(fp, "%s{\"threads\": %d, \"secs\": %.9g, "
+			"\"serial_secs\": %.9g, \"kops\": %.6g, "
+			"\"kops_per_thread\": [", t++ ? ", " : "", k, 
+			sc[k-1].secs, sc[k-1].serial, 
+			(st->ops/1e3)/sc[k-1].secs);
+		for (j = 0; j < k; j++)
+		    fprintf(fp, "%s%.6g", j ? ", " : "", sc[k-1].kops[j]);
+		fprintf(fp, "]}");
+	    }
+	    fprintf(fp, "]");
+	}
+	if (libc_stats != NULL) {
+	    lc = &libc_stats[i];
+	    fprintf(fp, ",\n     \"libc\": {\"valid\": %s", 
+		    lc->valid ? "true" : "false");
+	    if (lc->valid) {
+		fprintf(fp, ", \"ops\": %.0f, \"secs\": %.9g, "
+			"\"kops\": %.6g", lc->ops, lc->secs, 
+			(lc->ops/1e3)/lc->secs);
+		if (st->valid)
+		    fprintf(fp, ", \"mm_speedup\": %.6g", lc->secs/st->secs);
+		libc_ops += lc->ops;
+		libc_secs += lc->secs;
+	    }
+	    fprintf(fp, "}");
+	}
+	fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n");
+
+    fprintf(fp, "  \"summary\": {\"util\": %.6g, \"ops\": %.0f, "
+	    "\"secs\": %.9g, \"kops\": ", sum->util, sum->ops, sum->secs);
+    print_ratio(fp, "%.6g", sum->ops/1e3, sum->secs);
+    fprintf(fp, ", \"correct\": %d, "
+	    "\"traces\": %d, \"errors\": %d, \"util_points\": %.6g, "
+	    "\"thru_points\": %.6g, \"perf_index\": %.6g",
+	    sum->numcorrect, n, errors, sum->p1*100, sum->p2*100, 
+	    sum->perfindex);
+    if (libc_stats != NULL) {
+	fprintf(fp, ", \"libc_ops\": %.0f, \"libc_secs\": %.9g, "
+		"\"libc_kops\": ", libc_ops, libc_secs);
+	print_ratio(fp, "%.6g", libc_ops/1e3, libc_secs);
+    }
+    fprintf(fp, ", \"regressions\": %d}\n}\n", sum->regressions);
+}
+
+/*
+ * print_ratio - prints x/y in fmt, or null if y is 0, since JSON has no
+ *     inf or nan; a CSV field is left empty instead
+ */
+static void print_ratio(FILE *fp, char *fmt, double x, double y)
+{
+    if (y == 0)
+	fprintf(fp, (*fmt == ',') ? "," : "null");
+    else
+	fprintf(fp, fmt, x / y);
+}
+
+/*
+ * csv_string - prints str as a CSV field, quoted if it has to be
+ */
+static void csv_string(FILE *fp, char *str)
+{
+    if (strpbrk(str, ",\"\n") == NULL) {
+	fputs(str, fp);
+	return;
+    }
+    fputc('"', fp);
+    for (; *str; str++) {
+	if (*str == '"')
+	    fputc('"', fp);
+	fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * printcsv - prints one row per trace and a last "total" row. The
+ *     columns of a mode that did not run are left out, and a field
+ *     that was not measured is empty. Every row repeats the config
+ *     and host, so that rows from many runs can go in one table.
+ */
+static void printcsv(FILE *fp, char **tracefiles, int n, stats_t *stats,
+		     stats_t *libc_stats, summary_t *sum)
+{
+    host_t host;
+    stats_t *st, *lc;
+    bench_t *b;
+    hist_t *h;
+    double libc_ops = 0, libc_secs = 0;
+    int i, k, t;
+
+    get_host(&host);
+
+    /* The header */
+    fprintf(fp, "trace,name,valid,util,ops,secs,kops");
+    if (libc_stats != NULL)
+	fprintf(fp, ",libc_valid,libc_ops,libc_secs,libc_kops,mm_speedup");
+    if (reps > 0)
+	fprintf(fp, ",runs,kept,median,lo,hi,mean,sd");
+    if (tl_every > 0)
+	fprintf(fp, ",tl_samples,tw_util,ext_avg,ext_max,int_avg");
+    if (touch_every > 0) {
+	fprintf(fp, ",touch_sweeps,touch_secs,touch_kops");
+	for (k = 0; k < PERFCTR_N; k++)
+	    fprintf(fp, ",touch_%s", perfctr_name(k));
+    }
+#if MM_PROFILE
+    fprintf(fp, ",searches,candidates,max_candidates,exact,split,extend,"
+	    "remainder,padding");
+#endif
+#if MM_PHASES
+    fprintf(fp, ",phase_ticks");
+    for (k = 0; k < MM_NPHASES; k++)
+	fprintf(fp, ",%s_ticks", mm_phase_name(k));
+#endif
+#if MM_CACHESIM
+    fprintf(fp, ",sim_lines");
+    for (k = 0; k < CACHESIM_LEVELS; k++)
+	fprintf(fp, ",sim_%s_misses", cachesim_name(k));
+#endif
+    if (latency)
+	for (t = 0; t < NREQTYPES; t++)
+	    fprintf(fp, ",%s_count,%s_p50,%s_p90,%s_p99,%s_p99.9,%s_max",
+		    reqnames[t], reqnames[t], reqnames[t], reqnames[t],
+		    reqnames[t], reqnames[t]);
+    if (counters)
+	for (k = 0; k < PERFCTR_N; k++)
+	    fprintf(fp, ",%s", perfctr_name(k));
+    for (k = 1; k <= nthreads; k++)
+	fprintf(fp, ",kops_%dt", k);
+    fprintf(fp, ",perf_index,timer,alignment,max_heap,heap_limit,"
+	    "host,machine,cpu,cpus,time\n");
+
+    /* A row per trace, then the totals */
+    for (i=0; i <= n; i++) {
+	st = (i < n) ? &stats[i] : NULL;
+	lc = (i < n && libc_stats != NULL) ? &libc_stats[i] : NULL;
+	if (st == NULL) {
+	    fprintf(fp, "total,,%d,%.6g,%.0f,%.9g", 
+		    sum->numcorrect == n, sum->util, sum->ops, sum->secs);
+	    print_ratio(fp, ",%.6g", sum->ops/1e3, sum->secs);
+	}
+	else {
+	    fprintf(fp, "%d,", i);
+	    csv_string(fp, tracefiles[i]);
+	    if (st->valid)
+		fprintf(fp, ",1,%.6g,%.0f,%.9g,%.6g", st->util, st->ops, 
+			st->secs, (st->ops/1e3)/st->secs);
+	    else
+		fprintf(fp, ",0,,,,");
+	}
+
+	if (libc_stats != NULL) {
+	    if (lc == NULL) {
+		fprintf(fp, ",,%.0f,%.9g", libc_ops, libc_secs);
+		print_ratio(fp, ",%.6g", libc_ops/1e3, libc_secs);
+		print_ratio(fp, ",%.6g", libc_secs, sum->secs);
+	    }
+	    else if (lc->valid) {
+		fprintf(fp, ",1,%.0f,%.9g,%.6g,", lc->ops, lc->secs, 
+			(lc->ops/1e3)/lc->secs);
+		if (st->valid)
+		    fprintf(fp, "%.6g", lc->secs/st->secs);
+		libc_ops += lc->ops;
+		libc_secs += lc->secs;
+	    }
+	    else
+		fprintf(fp, ",0,,,,");
+	}
+	if (reps > 0) {
+	    b = (st != NULL) ? &st->runs : NULL;
+	    if (b != NULL && st->valid && b->runs > 0)
+		fprintf(fp, ",%d,%d,%.6g,%.6g,%.6g,%.6g,%.6g", b->runs, 
+			b->kept, b->median, b->lo, b->hi, b->mean, b->sd);
+	    else
+		fprintf(fp, ",,,,,,,");
+	}
+	if (tl_every > 0) {
+	    if (st != NULL && st->valid && st->tl.samples > 0)
+		fprintf(fp, ",%ld,%.6g,%.6g,%.6g,%.6g", st->tl.samples, 
+			st->tl.twutil, st->tl.ext_avg, st->tl.ext_max, 
+			st->tl.int_avg);
+	    else
+		fprintf(fp, ",,,,,");
+	}
+	if (touch_every > 0) {
+	    if (st != NULL && st->valid && st->touch.secs > 0)
+		fprintf(fp, ",%ld,%.9g,%.6g", st->touch.sweeps, 
+			st->touch.secs, (st->ops/1e3)/st->touch.secs);
+	    else
+		fprintf(fp, ",,,");
+	    for (k = 0; k < PERFCTR_N; k++) {
+		if (st != NULL && st->valid && st->touch.secs > 0 &&
+		    st->touch.ctrs.count[k] >= 0)
+		    fprintf(fp, ",%.0f", st->touch.ctrs.count[k]);
+		else
+		    fprintf(fp, ",");
+	    }
+	}
+#if MM_PROFILE
+	if (st != NULL && st->valid && st->prof.searches > 0)
+	    fprintf(fp, ",%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", st->prof.searches,
+		    st->prof.candidates, st->prof.max_candidates, 
+		    st->prof.exact, st->prof.split, st->prof.extend, 
+		    st->prof.remainder, st->prof.padding);
+	else
+	    fprintf(fp, ",,,,,,,,");
+#endif
+#if MM_PHASES
+	if (st != NULL && st->valid && st->phase_ticks > 0) {
+	    fprintf(fp, ",%llu", st->phase_ticks);
+	    for (k = 0; k < MM_NPHASES; k++)
+		fprintf(fp, ",%llu", st->phases.ticks[k]);
+	}
+	else
+	    for (k = 0; k <= MM_NPHASES; k++)
+		fprintf(fp, ",");
+#endif
+#if MM_CACHESIM
+	if (st != NULL && st->valid && st->sim.accesses > 0) {
+	    fprintf(fp, ",%llu", st->sim.accesses);
+	    for (k = 0; k < CACHESIM_LEVELS; k++)
+		fprintf(fp, ",%llu", st->sim.misses[k]);
+	}
+	else
+	    for (k = 0; k <= CACHESIM_LEVELS; k++)
+		fprintf(fp, ",");
+#endif
+	for (t = 0; latency && t < NREQTYPES; t++) {
+	    h = (st != NULL && st->valid && st->lat != NULL) ? 
+		&st->lat[t] : NULL;
+	    if (h != NULL && h->total > 0)
+		fprintf(fp, ",%llu,%llu,%llu,%llu,%llu,%llu", h->total,
+			hist_percentile(h, 50.0), hist_percentile(h, 90.0),
+			hist_percentile(h, 99.0), hist_percentile(h, 99.9),
+			h->max);
+	    else
+		fprintf(fp, ",,,,,,");
+	}
+	for (k = 0; counters && k < PERFCTR_N; k++) {
+	    if (st != NULL && st->valid && st->ctrs.count[k] >= 0)
+		fprintf(fp, ",%.0f", st->ctrs.count[k]);
+	    else
+		fprintf(fp, ",");
+	}
+	for (k = 1; k <= nthreads; k++) {
+	    if (st != NULL && st->valid && st->scale != NULL && 
+		st->scale[k-1].kops != NULL)
+		fprintf(fp, ",%.6g", (st->ops/1e3)/st->scale[k-1].secs);
+	    else
+		fprintf(fp, ",");
+	}
+
+	if (st == NULL)
+	    fprintf(fp, ",%.6g", sum->perfindex);
+	else
+	    fprintf(fp, ",");
+	fprintf(fp, ",%s,%d,%lu,%lu,", fsecs_timer(), ALIGNMENT, 
+		(unsigned long)MAX_HEAP, (unsigned long)mem_max_heap());
+	csv_string(fp, host.uts.nodename);
+	fprintf(fp, ",%s,", host.uts.machine);
+	csv_string(fp, host.cpu);
+	fprintf(fp, ",%ld,%s\n", host.cpus, host.time);
+    }
 }
 
 /* 
@@ -1009,10 +4950,10 @@ void unix_error(char *msg)
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
-void malloc_error(int tracenum, int opnum, char *msg)
+void malloc_error(int tracenum, long opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [trace %d, line %ld]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
 /* 
@@ -1020,14 +4961,42 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValzLPU] [--format=<fmt>] [-H <size>] [-j <n>] [-p <n>] [-q <p:c[:n]>] [-r <n>] [-k <n>[:<w>]] [-m <n>[:<file>]] [-w <n>[:r]] [-C <spec>] [-R <refs>] [-s <file>] [-c <file>] [-T <u[:t]>] [-f <file>] [-t <dir>] [-b <file>] [-Z <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-b <file>  Convert the -f trace to binary <file> and exit.\n");
+    fprintf(stderr, "\t-C <spec>  Simulated caches of an MM_CACHESIM build, as size:ways for L1,\n");
+    fprintf(stderr, "\t           L2 and LLC (default %s).\n", CACHESIM_DEFAULT);
+    fprintf(stderr, "\t-c <file>  Compare to the baseline results in <file>; exit 2 on a regression.\n");
+    fprintf(stderr, "\t--format=<text|json|csv> Write the report to stdout in this format,\n");
+    fprintf(stderr, "\t           and everything else to stderr.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as the trace file (text, binary or stream).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <size>  Let the mm heap grow to <size> bytes (K, M, G suffixes).\n");
+    fprintf(stderr, "\t-j <n>     Also replay each trace in 1 to <n> threads.\n");
+    fprintf(stderr, "\t-k <n>[:<w>] Replay the traces <n> times on one heap, reporting\n");
+    fprintf(stderr, "\t           every <w> replays how it ages, and exit.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report per-request latency percentiles.\n");
+    fprintf(stderr, "\t-P         Report hardware event counts (instructions, misses...).\n");
+    fprintf(stderr, "\t-m <n>[:<file>] Sample fragmentation every <n> ops into <file>\n");
+    fprintf(stderr, "\t           (default timeline.csv); report util averaged over ops.\n");
+    fprintf(stderr, "\t-p <n>     Evaluate traces in up to <n> pinned worker processes.\n");
+    fprintf(stderr, "\t-R <refs>  Score throughput against the fastest of these allocators on\n");
+    fprintf(stderr, "\t           this host: libc, auto, or lib.so[:prefix], comma separated.\n");
+    fprintf(stderr, "\t-r <n>     Time <n> runs of each trace; report the median and 95%% CI.\n");
+    fprintf(stderr, "\t-q <p:c[:n]> Pass <n> messages from each of <p> producer threads\n");
+    fprintf(stderr, "\t           to <c> consumer threads that free them, and exit.\n");
+    fprintf(stderr, "\t-s <file>  Save the per-trace results to <file>, for use with -c.\n");
+    fprintf(stderr, "\t-T <u[:t]> Fail -c if util drops <u> points or Kops <t>%% (default 1:5).\n");
+    fprintf(stderr, "\t-U         Let throughput beyond the reference raise the index past 100.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <n>[:r] Also replay each trace writing its payloads, reading the\n");
+    fprintf(stderr, "\t           live ones every <n> ops (:r in random order); blocks\n");
+    fprintf(stderr, "\t           over 256MB only in their first and last 64KB.\n");
+    fprintf(stderr, "\t-Z <file>  Convert the -f trace to stream <file> and exit.\n");
+    fprintf(stderr, "\t-z         Give every run a fresh zero-filled heap.\n");
 }
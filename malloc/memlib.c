@@ -18,20 +18,32 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_hwm;        /* highest brk since mem_init; above is zero */
+static int mem_fresh = 0;    /* release the pages on every reset? */
+static size_t mem_max = MAX_HEAP;  /* bytes reserved for the heap */
 
 /*
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* 
+     * Map the storage we will use to model the available VM. A mapping
+     * is page aligned, so the heap starts out suitably aligned for any
+     * ALIGNMENT. No swap is reserved for it, so a heap far larger than
+     * memory can be mapped as long as the pages touched fit.
+     */
+    mem_start_brk = (char *)mmap(NULL, mem_max, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				 -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+    mem_max_addr = mem_start_brk + mem_max;   /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_hwm = mem_start_brk;
 }
 
 /*
@@ -39,35 +51,90 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, mem_max);
+    mem_start_brk = NULL;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_set_max_heap - set the most bytes the heap may grow to. Calling it
+ *    after mem_init maps a new, empty heap of that size.
+ */
+void mem_set_max_heap(size_t size)
+{
+    if (mem_start_brk != NULL) {
+	mem_deinit();
+	mem_max = size;
+	mem_init();
+    }
+    else
+	mem_max = size;
+}
+
+/*
+ * mem_max_heap - return the most bytes the heap may grow to
+ */
+size_t mem_max_heap()
+{
+    return mem_max;
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    After mem_set_fresh(1), the pages the heap used are also handed back
+ *    to the system, so the next run starts from zero-filled memory like
+ *    a new process would (and pays for the page faults).
  */
 void mem_reset_brk()
 {
+    if (mem_fresh && mem_hwm > mem_start_brk) {
+	if (madvise(mem_start_brk, mem_hwm - mem_start_brk, MADV_DONTNEED) < 0) {
+	    fprintf(stderr, "mem_reset_brk: madvise error\n");
+	    exit(1);
+	}
+	mem_hwm = mem_start_brk;
+    }
     mem_brk = mem_start_brk;
 }
 
+/*
+ * mem_set_fresh - choose whether mem_reset_brk returns the heap's pages
+ */
+void mem_set_fresh(int fresh)
+{
+    mem_fresh = fresh;
+}
+
 /*
  * mem_sbrk - simple model of the sbrk function. Extends the heap
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
  */
-void *mem_sbrk(int incr)
+void *mem_sbrk(intptr_t incr)
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ( (incr < 0) || (incr > mem_max_addr - mem_brk)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_brk > mem_hwm)
+	mem_hwm = mem_brk;
     return (void *)old_brk;
 }
 
+/*
+ * mem_heap_hwm - return the high-water mark of the brk pointer since
+ *    mem_init. Memory at and above it has never been part of the heap,
+ *    so it still holds the zeros the mapping started out with, even
+ *    after mem_reset_brk.
+ */
+void *mem_heap_hwm()
+{
+    return (void *)mem_hwm;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -1,11 +1,16 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
+void mem_set_fresh(int fresh);
+void mem_set_max_heap(size_t size);
+size_t mem_max_heap(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_hwm(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
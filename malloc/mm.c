@@ -1,15 +1,24 @@
 /*
- * Simple, 32-bit and 64-bit clean allocator based on implicit free
- * lists, first-fit placement, and boundary tag coalescing, as described
- * in the CS:APP3e text. Blocks must be aligned to doubleword (8 byte)
- * boundaries. Minimum block size is 16 bytes.
+ * Simple, 32-bit and 64-bit clean allocator based on an explicit free
+ * list, first-fit placement with splitting, and boundary tag coalescing,
+ * as described in the CS:APP3e text. Payloads are aligned to ALIGNMENT from
+ * config.h (at least a doubleword), and block sizes are multiples of it.
+ * Minimum block size is 2 doublewords.
  */
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
+#include "cachesim.h"
+#include "clock.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -36,16 +45,55 @@ team_t team = {
 #define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */  //line:vm:mm:endconst
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Payload alignment. The header is the word right before each payload and
+   the footer the word before the next header, so the only cost of a wider
+   alignment is rounding block sizes up to it: none when it is DSIZE. */
+#define BLKALIGN   MAX(ALIGNMENT, DSIZE)
+#define ALIGN_UP(n, a)  (((n) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+#if ALIGNMENT > 16
+#error "mm.c supports ALIGNMENT values up to 16"
+#endif
+
+/* mm_calloc zeroes blocks at least this big with non-temporal stores */
+#define STREAM_MIN (1<<18)
+
+/* A free block of csize bytes can hold an exact asize block if the rest is
+   either nothing or big enough to stand as a free block of its own. Every
+   allocated block is therefore exactly adjust_size() of its request, which
+   is what lets mm_free_sized trust the caller's size. */
+#define FITS(csize, asize) \
+  ((csize) == (asize) || (csize) >= (asize) + 2*DSIZE)
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) //line:vm:mm:pack
 
-/* Read and write a word at address p */
-#define GET(p)       (*(unsigned int *)(p))            //line:vm:mm:get
-#define PUT(p, val)  (*(unsigned int *)(p) = (val))    //line:vm:mm:put
+/* Cache simulation (MM_CACHESIM in config.h). SIM reports the n bytes
+   at p to cachesim.c, as an offset into the heap so that the counts do
+   not depend on where the heap was mapped, and yields p, so that the
+   accessors built on it are still lvalues. SIM_RANGE reports a run of
+   payload bytes. Neither reports anything when off. */
+#if MM_CACHESIM
+static inline void *sim_access(void *p, size_t n) {
+  cachesim_access((char *)p - (char *)mem_heap_lo(), n);
+  return p;
+}
+#define SIM(p, n)        sim_access((p), (n))
+#define SIM_RANGE(p, n)  ((void)sim_access((p), (n)))
+#else
+#define SIM(p, n)        (p)
+#define SIM_RANGE(p, n)
+#endif
+
+/* Read and write a word at address p. Headers and footers are a full
+   WSIZE word, so block sizes are not limited to 4GB. */
+#define GET(p)       (*(size_t *)SIM(p, WSIZE))            //line:vm:mm:get
+#define PUT(p, val)  (*(size_t *)SIM(p, WSIZE) = (val))    //line:vm:mm:put
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)                   //line:vm:mm:getsize
+#define GET_SIZE(p)  (GET(p) & ~(size_t)0x7)           //line:vm:mm:getsize
 #define GET_ALLOC(p) (GET(p) & 0x1)                    //line:vm:mm:getalloc
 
 /* Given block ptr bp, compute address of its header and footer */
@@ -60,8 +108,8 @@ team_t team = {
 /* bp is address of the free block. Since minimum Block size is 16 bytes,
    we utilize to store the address of previous block pointer and next block pointer.
 */
-#define FWD_PTR(bp)  (*(char **)(bp + WSIZE))
-#define BACK_PTR(bp)  (*(char **)(bp))
+#define FWD_PTR(bp)  (*(char **)SIM(bp + WSIZE, WSIZE))
+#define BACK_PTR(bp)  (*(char **)SIM(bp, WSIZE))
 
 /* Puts pointers in the next and previous elements of free list */
 #define SET_FWD_PTR(bp, qp) (FWD_PTR(bp) = qp)
@@ -70,11 +118,62 @@ team_t team = {
 /* Global variables */
 static char *heap_listp = 0;  /* Pointer to first block */
 static char *flist_head = 0;
+static char *fresh_lo = 0;    /* No payload from here up was handed out yet */
 static char *test = 0;
 
+/* One lock guards the whole heap once mm_set_threaded(1) is called */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int mm_threaded = 0;
+
+/* Fit-search profiling (MM_PROFILE in config.h). PROF_VAR declares a
+   candidate counter, PROF_TICK counts one free block examined, and
+   PROF_FIT records where a search ended; all three vanish when off. */
+#if MM_PROFILE
+static mm_prof_t prof;
+static void prof_fit(size_t seen, int how, size_t remainder, size_t padding);
+#define PROF_EXACT  0
+#define PROF_SPLIT  1
+#define PROF_EXTEND 2
+#define PROF_VAR(n)   size_t n = 0
+#define PROF_TICK(n)  ((n)++)
+#define PROF_FIT(n, ext, bp, asize, size) \
+  prof_fit((n), ((ext) ? PROF_EXTEND : \
+		 GET_SIZE(HDRP(bp)) == (asize) ? PROF_EXACT : PROF_SPLIT), \
+	   GET_SIZE(HDRP(bp)) - (asize), (asize) - (size))
+#else
+#define PROF_VAR(n)
+#define PROF_TICK(n)
+#define PROF_FIT(n, ext, bp, asize, size)
+#endif
+
+/* Phase timers (MM_PHASES in config.h). PHASE_VAR declares a start time,
+   PHASE_BEGIN reads the TSC into it, and PHASE_END adds the ticks since
+   then to one phase of this thread's counts; all vanish when off. */
+#if MM_PHASES
+static void phase_add(int phase, unsigned long long ticks);
+#define PHASE_VAR(t)      unsigned long long t
+#define PHASE_BEGIN(t)    ((t) = get_tsc())
+#define PHASE_END(ph, t)  phase_add((ph), get_tsc() - (t))
+#else
+#define PHASE_VAR(t)
+#define PHASE_BEGIN(t)
+#define PHASE_END(ph, t)
+#endif
+
+#define LOCK()    do { if (mm_threaded) pthread_mutex_lock(&mm_lock); } while (0)
+#define UNLOCK()  do { if (mm_threaded) pthread_mutex_unlock(&mm_lock); } while (0)
+
 static void *extend_heap(size_t words);
 static void add_flist(void *bp);
+static void *coalesce(void *bp);
+static void remove_flist(void *bp);
 static void place(void *bp, size_t size);
+static size_t adjust_size(size_t size);
+static size_t chunk_size(size_t want);
+static char *align_fit(char *bp, size_t alignment, size_t asize);
+static size_t carve(void *bp, size_t asize, size_t n, void **out);
+static int addr_cmp(const void *a, const void *b);
+static void zero_block(char *p, size_t n);
 
 /*************************************************
 *       CORE FUNCTIONS
@@ -85,6 +184,9 @@ static void place(void *bp, size_t size);
 /* $begin mminit */
 int mm_init(void)
 {
+    /* Memory the simulated heap has never reached is still zero */
+    fresh_lo = mem_heap_hwm();
+
     /* Create the initial empty heap */
     if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) //line:vm:mm:begininit
         return -1;
@@ -104,56 +206,524 @@ int mm_init(void)
 }
 /* $end mminit */
 
-void *mm_malloc(size_t size) {
+static void *mm_malloc_nolock(size_t size) {
 
   size_t asize;      /* Adjusted block size */
   size_t extendsize; /* Amount to extend heap if no fit */
   void *bp;
+  PROF_VAR(seen);    /* Free blocks examined */
+  PHASE_VAR(t0);
 
   /* Ignore spurious requests. */
   if (size == 0)
     return (NULL);
 
     /* Adjust block size to include overhead and alignment reqs. */
-  if (size <= DSIZE)                                          //line:vm:mm:sizeadjust1
-      asize = 2*DSIZE;                                        //line:vm:mm:sizeadjust2
-  else
-      asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); //line:vm:mm:sizeadjust3
+  asize = adjust_size(size);
 
 
+    PHASE_BEGIN(t0);
     for (bp = flist_head; GET_ALLOC(HDRP(bp)) == 0; bp = FWD_PTR(bp) ){
-      if (asize <= (size_t)GET_SIZE(HDRP(bp)) ) {
+      PROF_TICK(seen);
+      if (FITS((size_t)GET_SIZE(HDRP(bp)), asize)) {
+        PHASE_END(MM_PH_SEARCH, t0);
+        PROF_FIT(seen, 0, bp, asize, size);
         place(bp, asize);
         return bp;
       }
     }
+    PHASE_END(MM_PH_SEARCH, t0);
 
   /* No fit found. Get more memory and place the block */
-   extendsize = MAX(asize,CHUNKSIZE);                 //line:vm:mm:growheap1
+   extendsize = chunk_size(asize);                    //line:vm:mm:growheap1
    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
        return NULL;                        //line:vm:mm:growheap2
+   PROF_FIT(seen, 1, bp, asize, size);
    place(bp, asize);                            //line:vm:mm:growheap3
    return bp;
 }
 
-void mm_free(void *bp) {
+static void mm_free_nolock(void *bp) {
   size_t current = GET_SIZE(HDRP(bp));
   PUT(HDRP(bp), PACK(current, 0));
   PUT(FTRP(bp), PACK(current, 0));
-  add_flist(bp);
+  coalesce(bp);
+}
+
+/*
+ * mm_free_sized - Free a block whose size the caller already knows. size
+ *   must be the size passed to the call that returned ptr; the header is
+ *   then never read. Build with -DDEBUG to check size against the header.
+ */
+static void mm_free_sized_nolock(void *bp, size_t size) {
+
+  size_t asize = adjust_size(size);
+
+#ifdef DEBUG
+  if (asize != (size_t)GET_SIZE(HDRP(bp))) {
+    fprintf(stderr, "mm_free_sized: %p freed with size %zu, "
+            "but its block holds %zu bytes\n", bp, size, GET_SIZE(HDRP(bp)));
+    abort();
+  }
+#endif
+  PUT(HDRP(bp), PACK(asize, 0));
+  PUT((char *)bp + asize - DSIZE, PACK(asize, 0));
+  coalesce(bp);
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ *   A block lying wholly above fresh_lo has never been handed out, and the
+ *   only words written into it are the free-list links at its start, so
+ *   only those are cleared. Other blocks are zeroed in full, large ones
+ *   with streaming stores.
+ */
+static void *mm_calloc_nolock(size_t nmemb, size_t size) {
+
+  size_t bytes;
+  char *fresh = fresh_lo;
+  char *bp;
+
+  if (nmemb != 0 && size > (size_t)-1 / nmemb)
+    return NULL;
+  bytes = nmemb * size;
+
+  if ((bp = mm_malloc_nolock(bytes)) == NULL)
+    return NULL;
+  if (bp >= fresh) {
+    SIM_RANGE(bp, MIN(bytes, 2*WSIZE));
+    memset(bp, 0, MIN(bytes, 2*WSIZE));
+  }
+  else
+    zero_block(bp, bytes);
+  return bp;
+}
+
+/*
+ * mm_usable_size - Number of payload bytes the caller may use in the block
+ *   at bp, which can exceed the requested size by the alignment rounding.
+ */
+static size_t mm_usable_size_nolock(void *bp) {
+  return GET_SIZE(HDRP(bp)) - DSIZE;
+}
+
+/*
+ * mm_realloc - Keep the block when the new size rounds to the same block,
+ *   shrink it in place when the tail can be split off, and otherwise move
+ *   the payload to a new block.
+ */
+static void *mm_realloc_nolock(void *ptr, size_t size) {
+
+  size_t asize, csize;
+  void *newptr;
+  PHASE_VAR(t0);
+
+  if (ptr == NULL)
+    return mm_malloc_nolock(size);
+  if (size == 0) {
+    mm_free_nolock(ptr);
+    return NULL;
+  }
+
+  asize = adjust_size(size);
+  csize = GET_SIZE(HDRP(ptr));
+  if (asize == csize)
+    return ptr;
+  if (csize >= asize + 2*DSIZE) {
+    PUT(HDRP(ptr), PACK(asize, 1));
+    PUT(FTRP(ptr), PACK(asize, 1));
+    PUT(HDRP(NEXT_BLKP(ptr)), PACK(csize - asize, 0));
+    PUT(FTRP(NEXT_BLKP(ptr)), PACK(csize - asize, 0));
+    coalesce(NEXT_BLKP(ptr));
+    return ptr;
+  }
+
+  if ((newptr = mm_malloc_nolock(size)) == NULL)
+    return NULL;
+  PHASE_BEGIN(t0);
+  SIM_RANGE(ptr, MIN(size, csize - DSIZE));
+  SIM_RANGE(newptr, MIN(size, csize - DSIZE));
+  memcpy(newptr, ptr, MIN(size, csize - DSIZE));
+  PHASE_END(MM_PH_COPY, t0);
+  mm_free_nolock(ptr);
+  return newptr;
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload is aligned to alignment, a
+ *   power of two no larger than the page size. The slack in front of the
+ *   aligned payload is split off as a free block of its own rather than
+ *   wasted. Returns NULL for an unsupported alignment.
+ */
+static void *mm_memalign_nolock(size_t alignment, size_t size) {
+
+  size_t asize;      /* Adjusted block size */
+  size_t extendsize; /* Amount to extend heap if no fit */
+  char *bp, *ap;
+  PHASE_VAR(t0);
+
+  if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) ||
+      alignment > mem_pagesize())
+    return NULL;
+  if (alignment <= BLKALIGN)          /* every payload is this aligned */
+    return mm_malloc_nolock(size);
+
+  asize = adjust_size(size);
+
+  PHASE_BEGIN(t0);
+  for (bp = flist_head; GET_ALLOC(HDRP(bp)) == 0; bp = FWD_PTR(bp))
+    if ((ap = align_fit(bp, alignment, asize)) != NULL)
+      break;
+  PHASE_END(MM_PH_SEARCH, t0);
+
+  /* No fit found. Get enough memory for the worst-case slack, which is
+     alignment + 2*DSIZE when align_fit has to skip a slack too small to
+     be a free block, and for a remainder after the block to split off */
+  if (GET_ALLOC(HDRP(bp))) {
+    extendsize = chunk_size(asize + alignment + 4*DSIZE);
+    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+      return NULL;
+    if ((ap = align_fit(bp, alignment, asize)) == NULL)
+      return NULL;
+  }
+
+  if (ap != bp) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t slack = ap - bp;
+
+    remove_flist(bp);
+    PUT(HDRP(bp), PACK(slack, 0));
+    PUT(FTRP(bp), PACK(slack, 0));
+    add_flist(bp);
+    PUT(HDRP(ap), PACK(csize - slack, 0));
+    PUT(FTRP(ap), PACK(csize - slack, 0));
+    add_flist(ap);
+  }
+  place(ap, asize);
+  return ap;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes each and store their
+ *   payload pointers in out. Blocks are carved back to back out of one free
+ *   span at a time, so the size adjustment, fit search and list unlinking
+ *   are paid per span instead of per block. Returns the number of blocks
+ *   allocated, which is less than n only if the heap ran out.
+ */
+static size_t mm_malloc_batch_nolock(size_t size, size_t n, void **out) {
+
+  size_t asize;      /* Adjusted block size */
+  size_t extendsize; /* Amount to extend heap if no fit */
+  size_t done = 0;
+  void *bp;
+  PHASE_VAR(t0);
+
+  if (size == 0)
+    return 0;
+
+  asize = adjust_size(size);
+
+  while (done < n) {
+    /* First fit, exactly as for a single block; the span found then
+       supplies as many of the remaining blocks as it can hold */
+    PHASE_BEGIN(t0);
+    for (bp = flist_head; GET_ALLOC(HDRP(bp)) == 0; bp = FWD_PTR(bp))
+      if (FITS((size_t)GET_SIZE(HDRP(bp)), asize))
+        break;
+    PHASE_END(MM_PH_SEARCH, t0);
+
+    if (GET_ALLOC(HDRP(bp))) {
+      extendsize = chunk_size(asize * (n - done));
+      if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+        return done;
+    }
+    done += carve(bp, asize, n - done, out + done);
+  }
+  return done;
+}
+
+/*
+ * mm_free_batch - Free n blocks at once. The pointers are sorted by address
+ *   (in place), and each run of blocks that sit next to each other in the
+ *   heap is released and coalesced as a single free block.
+ */
+static void mm_free_batch_nolock(void **ptrs, size_t n) {
+
+  size_t i;
+  size_t size;
+  char *bp;
+
+  /* Batches usually come back in the order they were carved */
+  for (i = 1; i < n && (char *)ptrs[i-1] < (char *)ptrs[i]; i++)
+    ;
+  if (i < n)
+    qsort(ptrs, n, sizeof(void *), addr_cmp);
+
+  i = 0;
+
+  while (i < n) {
+    bp = ptrs[i++];
+    size = GET_SIZE(HDRP(bp));
+    while (i < n && (char *)ptrs[i] == bp + size)
+      size += GET_SIZE(HDRP(ptrs[i++]));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    coalesce(bp);
+  }
+}
+
+/*************************************************
+*       LOCKED ENTRY POINTS
+*************************************************/
+/*
+ * The allocator has a single heap and free list, so calls from several
+ *   threads are serialised by one mutex around each entry point. It is
+ *   only taken after mm_set_threaded(1), which keeps the single-threaded
+ *   driver runs free of locking costs.
+ */
+void mm_set_threaded(int threaded) {
+  mm_threaded = threaded;
+}
+
+void *mm_malloc(size_t size) {
+  void *p;
+
+  LOCK();
+  p = mm_malloc_nolock(size);
+  UNLOCK();
+  return p;
+}
+
+void mm_free(void *bp) {
+  LOCK();
+  mm_free_nolock(bp);
+  UNLOCK();
+}
+
+void mm_free_sized(void *bp, size_t size) {
+  LOCK();
+  mm_free_sized_nolock(bp, size);
+  UNLOCK();
+}
+
+void *mm_calloc(size_t nmemb, size_t size) {
+  void *p;
+
+  LOCK();
+  p = mm_calloc_nolock(nmemb, size);
+  UNLOCK();
+  return p;
+}
+
+size_t mm_usable_size(void *bp) {
+  size_t n;
+
+  LOCK();
+  n = mm_usable_size_nolock(bp);
+  UNLOCK();
+  return n;
 }
 
 void *mm_realloc(void *ptr, size_t size) {
-  return ptr;
+  void *p;
+
+  LOCK();
+  p = mm_realloc_nolock(ptr, size);
+  UNLOCK();
+  return p;
+}
+
+void *mm_memalign(size_t alignment, size_t size) {
+  void *p;
+
+  LOCK();
+  p = mm_memalign_nolock(alignment, size);
+  UNLOCK();
+  return p;
+}
+
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+  size_t done;
+
+  LOCK();
+  done = mm_malloc_batch_nolock(size, n, out);
+  UNLOCK();
+  return done;
+}
+
+void mm_free_batch(void **ptrs, size_t n) {
+  LOCK();
+  mm_free_batch_nolock(ptrs, n);
+  UNLOCK();
+}
+
+/*
+ * mm_heapinfo - Walk the heap from the prologue to the epilogue, adding
+ *   up the allocated and free blocks. This is for introspection: it
+ *   takes time in the number of blocks.
+ */
+void mm_heapinfo(mm_heapinfo_t *hi) {
+
+  char *bp;
+  size_t size;
+
+  memset(hi, 0, sizeof(*hi));
+  LOCK();
+  for (bp = NEXT_BLKP(heap_listp + DSIZE); (size = GET_SIZE(HDRP(bp))) > 0;
+       bp = NEXT_BLKP(bp)) {
+    if (GET_ALLOC(HDRP(bp))) {
+      hi->alloc_bytes += size;
+      hi->alloc_blocks++;
+    }
+    else {
+      hi->free_bytes += size;
+      hi->free_blocks++;
+      hi->largest_free = MAX(hi->largest_free, size);
+    }
+  }
+  UNLOCK();
+}
+
+#if MM_PHASES
+/*************************************************
+*       PHASE TIMERS
+*************************************************/
+static __thread mm_phases_t ph_local;   /* this thread's counts */
+static __thread int ph_registered = 0;  /* ... and are they on ph_key? */
+static mm_phases_t ph_total;            /* counts of exited threads */
+static pthread_mutex_t ph_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ph_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ph_key;
+
+static char *ph_names[MM_NPHASES] = {
+  "search", "place", "coalesce", "extend", "copy"
+};
+
+/*
+ * phase_exit - Add an exiting thread's counts to the totals
+ */
+static void phase_exit(void *p) {
+  mm_phases_t *ph = p;
+  int i;
+
+  pthread_mutex_lock(&ph_lock);
+  for (i = 0; i < MM_NPHASES; i++) {
+    ph_total.ticks[i] += ph->ticks[i];
+    ph_total.calls[i] += ph->calls[i];
+  }
+  pthread_mutex_unlock(&ph_lock);
+}
+
+static void phase_key(void) {
+  pthread_key_create(&ph_key, phase_exit);
+}
+
+/*
+ * phase_add - Count ticks in phase for this thread. A thread's first
+ *   count puts its counters on ph_key, whose destructor hands them to
+ *   the totals when the thread exits.
+ */
+static void phase_add(int phase, unsigned long long ticks) {
+  ph_local.ticks[phase] += ticks;
+  ph_local.calls[phase]++;
+  if (!ph_registered) {
+    pthread_once(&ph_once, phase_key);
+    pthread_setspecific(ph_key, &ph_local);
+    ph_registered = 1;
+  }
+}
+
+/*
+ * mm_phases - Sum the totals and this thread's counts into *ph;
+ *   mm_phases_reset - Zero them; mm_phase_name - Name a phase
+ */
+void mm_phases(mm_phases_t *ph) {
+  int i;
+
+  pthread_mutex_lock(&ph_lock);
+  for (i = 0; i < MM_NPHASES; i++) {
+    ph->ticks[i] = ph_total.ticks[i] + ph_local.ticks[i];
+    ph->calls[i] = ph_total.calls[i] + ph_local.calls[i];
+  }
+  pthread_mutex_unlock(&ph_lock);
+}
+
+void mm_phases_reset(void) {
+  pthread_mutex_lock(&ph_lock);
+  memset(&ph_total, 0, sizeof(ph_total));
+  pthread_mutex_unlock(&ph_lock);
+  memset(&ph_local, 0, sizeof(ph_local));
+}
+
+char *mm_phase_name(int phase) {
+  return ph_names[phase];
+}
+#endif
+
+#if MM_PROFILE
+/*************************************************
+*       PROFILING
+*************************************************/
+/*
+ * prof_bucket - Histogram bucket of v: 0 for 0, else 1 + floor(log2 v)
+ */
+static int prof_bucket(size_t v) {
+  int k = 0;
+
+  while (v != 0 && k < MM_PROF_BUCKETS - 1) {
+    v >>= 1;
+    k++;
+  }
+  return k;
+}
+
+/*
+ * prof_fit - Count a search that examined seen free blocks and placed
+ *   the block as how says, splitting off remainder bytes and adding
+ *   padding bytes to the request
+ */
+static void prof_fit(size_t seen, int how, size_t remainder, size_t padding) {
+  prof.searches++;
+  if (how == PROF_EXACT)
+    prof.exact++;
+  else if (how == PROF_SPLIT)
+    prof.split++;
+  else
+    prof.extend++;
+  prof.candidates += seen;
+  prof.max_candidates = MAX(prof.max_candidates, seen);
+  prof.remainder += remainder;
+  prof.padding += padding;
+  prof.search_hist[prof_bucket(seen)]++;
+  prof.remainder_hist[prof_bucket(remainder)]++;
+}
+
+/*
+ * mm_stats - Copy out the profile; mm_stats_reset - Start a new one
+ */
+void mm_stats(mm_prof_t *p) {
+  LOCK();
+  *p = prof;
+  UNLOCK();
+}
+
+void mm_stats_reset(void) {
+  LOCK();
+  memset(&prof, 0, sizeof(prof));
+  UNLOCK();
 }
+#endif
 
 static void *extend_heap(size_t words) {
 
-    char *bp;
+    char *bp, *newbp;
     size_t size;
+    PHASE_VAR(t0);
+
+    PHASE_BEGIN(t0);
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+    /* Allocate a multiple of the block alignment */
+    size = ALIGN_UP(words * WSIZE, BLKALIGN);
 
     size = MAX(size, OVERHEAD);
 
@@ -162,16 +732,24 @@ static void *extend_heap(size_t words) {
 
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
-    PUT(NEXT_BLKP(bp), PACK(0,1));
-
-    add_flist(bp);
-
-    return bp;
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+    PHASE_END(MM_PH_EXTEND, t0);
+
+    /* Merged into the free block before it: the old footer and our header
+       are payload now, and clearing them keeps fresh memory zero */
+    if ((newbp = coalesce(bp)) != bp) {
+      PUT(HDRP(bp), 0);
+      PUT(bp - DSIZE, 0);
+    }
+    return newbp;
 }
 
+/* The list ends at the prologue, whose payload slot is its footer, so the
+   back pointer of that sentinel is never written. */
 static void add_flist(void *bp) {
       SET_FWD_PTR(bp, flist_head);
-      SET_BACK_PTR(flist_head, bp);
+      if (!GET_ALLOC(HDRP(flist_head)))
+        SET_BACK_PTR(flist_head, bp);
       SET_BACK_PTR(bp, NULL);
       flist_head = bp;
 }
@@ -183,13 +761,185 @@ static void remove_flist(void *bp) {
   }
   else
     flist_head = FWD_PTR(bp);
-  SET_BACK_PTR(FWD_PTR(bp), BACK_PTR(bp));
+  if (!GET_ALLOC(HDRP(FWD_PTR(bp))))
+    SET_BACK_PTR(FWD_PTR(bp), BACK_PTR(bp));
+}
+
+/*
+ * coalesce - Boundary tag coalescing of free block bp with its free
+ *   neighbours. The merged block goes on the free list and is returned.
+ */
+static void *coalesce(void *bp) {
+
+  size_t prev_alloc = GET_ALLOC((char *)bp - DSIZE);
+  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+  size_t size = GET_SIZE(HDRP(bp));
+  PHASE_VAR(t0);
+
+  PHASE_BEGIN(t0);
+  if (!next_alloc) {
+    remove_flist(NEXT_BLKP(bp));
+    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+  }
+  if (!prev_alloc) {
+    bp = PREV_BLKP(bp);
+    remove_flist(bp);
+    size += GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+  }
+  add_flist(bp);
+  PHASE_END(MM_PH_COALESCE, t0);
+  return bp;
 }
 
 static void place(void *bp, size_t size) {
 
   size_t current = GET_SIZE(HDRP(bp));
-  PUT(HDRP(bp), PACK(current, 1));
-  PUT(FTRP(bp), PACK(current, 1));
+  PHASE_VAR(t0);
+
+  PHASE_BEGIN(t0);
   remove_flist(bp);
+  if ((char *)bp + size > fresh_lo)
+    fresh_lo = (char *)bp + size;
+  if (current == size) {
+    PUT(HDRP(bp), PACK(current, 1));
+    PUT(FTRP(bp), PACK(current, 1));
+    PHASE_END(MM_PH_PLACE, t0);
+    return;
+  }
+
+  /* Split, returning the tail to the free list (FITS guarantees it is
+     big enough to be a block) */
+  PUT(HDRP(bp), PACK(size, 1));
+  PUT(FTRP(bp), PACK(size, 1));
+  bp = NEXT_BLKP(bp);
+  PUT(HDRP(bp), PACK(current - size, 0));
+  PUT(FTRP(bp), PACK(current - size, 0));
+  add_flist(bp);
+  PHASE_END(MM_PH_PLACE, t0);
+}
+
+/*
+ * adjust_size - Block size for a payload of size bytes, including the
+ *   header/footer overhead and alignment
+ */
+static size_t adjust_size(size_t size) {
+
+  if (size <= DSIZE)                                          //line:vm:mm:sizeadjust1
+    return ALIGN_UP(2*DSIZE, BLKALIGN);                       //line:vm:mm:sizeadjust2
+  return ALIGN_UP(size + DSIZE, BLKALIGN);                    //line:vm:mm:sizeadjust3
+}
+
+/*
+ * chunk_size - Number of bytes to extend the heap by for want bytes of
+ *   blocks, never leaving a remainder too small to be a free block
+ */
+static size_t chunk_size(size_t want) {
+
+  size_t extendsize = MAX(want, CHUNKSIZE);
+
+  return FITS(extendsize, want) ? extendsize : want;
+}
+
+/*
+ * align_fit - Payload address inside free block bp that is aligned to
+ *   alignment and can hold an asize block, or NULL if there is none. Any
+ *   slack in front of it is big enough to be a free block.
+ */
+static char *align_fit(char *bp, size_t alignment, size_t asize) {
+
+  size_t csize = GET_SIZE(HDRP(bp));
+  size_t slack;
+  char *ap;
+
+  ap = (char *)(((size_t)bp + alignment - 1) & ~(alignment - 1));
+  if (ap != bp && ap - bp < 2*DSIZE)
+    ap += alignment;
+  slack = ap - bp;
+  if (slack > csize || !FITS(csize - slack, asize))
+    return NULL;
+  return ap;
+}
+
+/*
+ * carve - Cut up to n allocated blocks of asize bytes from the front of free
+ *   block bp in one pass, storing their payload pointers in out. Whatever is
+ *   left becomes a free block again; a remainder too small for that is
+ *   avoided by leaving the last block uncarved. Returns the number of
+ *   blocks carved.
+ */
+static size_t carve(void *bp, size_t asize, size_t n, void **out) {
+
+  size_t csize = GET_SIZE(HDRP(bp));
+  size_t rem;
+  size_t i, k;
+  PHASE_VAR(t0);
+
+  PHASE_BEGIN(t0);
+  k = csize / asize;
+  if (k > n)
+    k = n;
+  rem = csize - k * asize;
+  if (rem != 0 && rem < 2*DSIZE) {
+    k--;
+    rem += asize;
+  }
+
+  remove_flist(bp);
+  for (i = 0; i < k; i++) {
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    out[i] = bp;
+    bp = (char *)bp + asize;
+  }
+  if ((char *)bp > fresh_lo)
+    fresh_lo = bp;
+
+  if (rem >= 2*DSIZE) {
+    PUT(HDRP(bp), PACK(rem, 0));
+    PUT(FTRP(bp), PACK(rem, 0));
+    add_flist(bp);
+  }
+  PHASE_END(MM_PH_PLACE, t0);
+  return k;
+}
+
+/*
+ * addr_cmp - qsort comparator ordering payload pointers by address
+ */
+static int addr_cmp(const void *a, const void *b) {
+
+  char *pa = *(char * const *)a;
+  char *pb = *(char * const *)b;
+
+  return (pa > pb) - (pa < pb);
+}
+
+/*
+ * zero_block - Clear n bytes at p. Big blocks are cleared with 16-byte
+ *   non-temporal stores, which go around the cache instead of evicting
+ *   the working set for memory the caller may not touch for a while.
+ */
+static void zero_block(char *p, size_t n) {
+
+#if defined(__SSE2__)
+  if (n >= STREAM_MIN && ((size_t)p & 15) == 0) {
+    __m128i zero = _mm_setzero_si128();
+    char *end = p + (n & ~(size_t)63);
+
+    for (; p < end; p += 64) {
+      _mm_stream_si128((__m128i *)p, zero);
+      _mm_stream_si128((__m128i *)(p + 16), zero);
+      _mm_stream_si128((__m128i *)(p + 32), zero);
+      _mm_stream_si128((__m128i *)(p + 48), zero);
+    }
+    _mm_sfence();
+    n &= 63;
+  }
+#endif
+  SIM_RANGE(p, n);
+  memset(p, 0, n);
 }
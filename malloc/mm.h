@@ -4,6 +4,74 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+
+/* Batch interfaces: n same-sized blocks per call */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Serialise calls with a lock so several threads can share the heap */
+extern void mm_set_threaded(int threaded);
+
+/* A census of the heap, taken by walking every block */
+typedef struct {
+    size_t alloc_bytes;   /* in allocated blocks, with headers and padding */
+    size_t alloc_blocks;
+    size_t free_bytes;    /* in free blocks, with their headers */
+    size_t free_blocks;
+    size_t largest_free;  /* size of the largest free block */
+} mm_heapinfo_t;
+
+extern void mm_heapinfo(mm_heapinfo_t *hi);
+
+/* Profile of the fit searches since the last mm_stats_reset, kept only
+   when mm.c is built with MM_PROFILE. Bucket 0 of a histogram counts
+   zeros, and bucket k > 0 values from 2^(k-1) to 2^k - 1. */
+#define MM_PROF_BUCKETS 32
+
+typedef struct {
+    unsigned long searches;      /* fits mm_malloc looked for, also for
+				    calloc and the moves of realloc */
+    unsigned long exact;         /* ... served by a free block of just the size */
+    unsigned long split;         /* ... by splitting a bigger free block */
+    unsigned long extend;        /* ... by extending the heap */
+    unsigned long candidates;    /* free blocks examined in all */
+    unsigned long max_candidates;
+    unsigned long remainder;     /* bytes split off the chosen blocks */
+    unsigned long padding;       /* bytes of header and alignment added */
+    unsigned long search_hist[MM_PROF_BUCKETS];    /* candidates per search */
+    unsigned long remainder_hist[MM_PROF_BUCKETS]; /* remainder per search */
+} mm_prof_t;
+
+extern void mm_stats(mm_prof_t *prof);
+extern void mm_stats_reset(void);
+
+/* TSC ticks spent in each phase of the allocator, kept only when mm.c is
+   built with MM_PHASES. The phases do not overlap: extend_heap's time
+   stops where it coalesces, and a realloc that moves its block counts
+   the copy here and the malloc and free in their own phases. Each
+   thread counts on its own; its counts join the totals when it exits. */
+#define MM_PH_SEARCH   0   /* walking the free list for a fit */
+#define MM_PH_PLACE    1   /* place and carve, with their splits */
+#define MM_PH_COALESCE 2
+#define MM_PH_EXTEND   3   /* extend_heap, mem_sbrk included */
+#define MM_PH_COPY     4   /* realloc's memcpy */
+#define MM_NPHASES     5
+
+typedef struct {
+    unsigned long long ticks[MM_NPHASES];
+    unsigned long long calls[MM_NPHASES];
+} mm_phases_t;
+
+/* The totals of the threads that exited plus the calling thread's counts */
+extern void mm_phases(mm_phases_t *ph);
+/* Zero the totals and the calling thread's counts; no other thread
+   should be in the allocator */
+extern void mm_phases_reset(void);
+extern char *mm_phase_name(int phase);
 
 
 /* 
@@ -0,0 +1,372 @@
+/*
+ * pcbench.c - Producer/consumer benchmark of cross-thread frees
+ *
+ * Each consumer owns a bounded queue, and producer p sends its message
+ * number i to consumer (i + p) % consumers, so every producer feeds
+ * every consumer. A message starts with a header naming its producer,
+ * its size and its number, and its last byte holds the low byte of the
+ * number, if it is longer than the header; the consumer checks both
+ * before freeing it. Producers block when a queue is full, which bounds
+ * the bytes in flight. Once all the producers are done, each queue gets
+ * a NULL to stop its consumer.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <float.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "clock.h"
+#include "hist.h"
+#include "pcbench.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* The header at the start of every message */
+typedef struct {
+    int producer;
+    int size;
+    long seq;
+} msg_t;
+
+/* A consumer's queue of messages */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    pthread_cond_t nonfull;
+    void *slots[PC_QUEUE];
+    int head;                  /* oldest message */
+    int count;                 /* messages waiting */
+} queue_t;
+
+/* What the threads of a run share */
+typedef struct {
+    pc_config_t *cfg;
+    queue_t *queues;           /* one per consumer */
+    pthread_barrier_t start;   /* lets every thread go at once */
+    size_t live;               /* bytes sent and not yet freed */
+    pc_result_t *res;          /* the first producer adds heap samples */
+} bench_t;
+
+/* One producer or consumer */
+typedef struct {
+    bench_t *b;
+    int id;
+    int valid;                 /* a consumer got only intact messages */
+    double begin, end;         /* wall clock when it started and was done */
+    hist_t lat;                /* cycles per malloc or free */
+} worker_t;
+
+/*
+ * pc_error - Report a failure that ends the benchmark, and exit
+ */
+static void pc_error(char *msg)
+{
+    fprintf(stderr, "ERROR: producer/consumer benchmark: %s\n", msg);
+    exit(1);
+}
+
+/*
+ * wall_secs - Seconds on a clock that only ever moves forward
+ */
+static double wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * heap_bytes - Bytes of heap the allocator has taken from the system,
+ *     or 0 when that cannot be told
+ */
+static size_t heap_bytes(int libc)
+{
+    if (!libc)
+	return mem_heapsize();
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    {
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.arena + mi.hblkhd;
+    }
+#else
+    return 0;
+#endif
+}
+
+/*
+ * sample_size - Next message size, log-uniform from PC_MIN_SIZE to
+ *     PC_MAX_SIZE: a power of two lo in that range is picked uniformly,
+ *     then a size from lo up to 2*lo
+ */
+static int sample_size(unsigned int *x)
+{
+    int classes, lo;
+
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    for (classes = 0; (PC_MIN_SIZE << classes) < PC_MAX_SIZE; classes++)
+	;
+    lo = PC_MIN_SIZE << (*x % classes);
+    return lo + (*x >> 8) % lo;
+}
+
+/*
+ * put_msg - Add message p to queue q, waiting while q is full
+ */
+static void put_msg(queue_t *q, void *p)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == PC_QUEUE)
+	pthread_cond_wait(&q->nonfull, &q->lock);
+    q->slots[(q->head + q->count++) % PC_QUEUE] = p;
+    pthread_cond_signal(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * get_msg - Take the oldest message off queue q, waiting while q is empty
+ */
+static void *get_msg(queue_t *q)
+{
+    void *p;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0)
+	pthread_cond_wait(&q->nonempty, &q->lock);
+    p = q->slots[q->head];
+    q->head = (q->head + 1) % PC_QUEUE;
+    q->count--;
+    pthread_cond_signal(&q->nonfull);
+    pthread_mutex_unlock(&q->lock);
+    return p;
+}
+
+/*
+ * producer - Allocate, fill in and send cfg->msgs messages. The first
+ *     producer also samples the heap PC_SAMPLES times along the way.
+ */
+static void *producer(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    bench_t *b = w->b;
+    pc_config_t *cfg = b->cfg;
+    pc_sample_t *sp;
+    unsigned int x = 2463534242u + 2654435761u * w->id;
+    unsigned long long t0, t1;
+    long seq, step;
+    int size;
+    char *p;
+    msg_t *m;
+
+    step = (cfg->msgs + PC_SAMPLES - 1) / PC_SAMPLES;
+    pthread_barrier_wait(&b->start);
+    w->begin = wall_secs();
+    for (seq = 0; seq < cfg->msgs; seq++) {
+	size = sample_size(&x);
+	t0 = get_tsc_serial();
+	p = cfg->libc ? malloc(size) : mm_malloc(size);
+	t1 = get_tsc_serial();
+	if (p == NULL)
+	    pc_error("malloc failed");
+	hist_record(&w->lat, (t1 - t0 > cfg->tsc_ovhd) ? 
+		    t1 - t0 - cfg->tsc_ovhd : 0);
+
+	m = (msg_t *)p;
+	m->producer = w->id;
+	m->size = size;
+	m->seq = seq;
+	if (size > (int)sizeof(msg_t))
+	    p[size - 1] = (char)seq;
+	__atomic_add_fetch(&b->live, size, __ATOMIC_RELAXED);
+	put_msg(&b->queues[(seq + w->id) % cfg->consumers], p);
+
+	if (w->id == 0 && (seq + 1) % step == 0) {
+	    sp = &b->res->samples[b->res->nsamples++];
+	    sp->secs = wall_secs() - w->begin;
+	    sp->sent = seq + 1;
+	    sp->heap = heap_bytes(cfg->libc);
+	    sp->live = __atomic_load_n(&b->live, __ATOMIC_RELAXED);
+	}
+    }
+    w->end = wall_secs();
+    return NULL;
+}
+
+/*
+ * consumer - Check and free the messages on this consumer's queue
+ *     until the NULL that ends it
+ */
+static void *consumer(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    bench_t *b = w->b;
+    pc_config_t *cfg = b->cfg;
+    unsigned long long t0, t1;
+    char *p;
+    msg_t *m;
+
+    pthread_barrier_wait(&b->start);
+    w->begin = wall_secs();
+    while ((p = get_msg(&b->queues[w->id])) != NULL) {
+	m = (msg_t *)p;
+	if (m->producer < 0 || m->producer >= cfg->producers ||
+	    m->size < PC_MIN_SIZE || m->size > PC_MAX_SIZE ||
+	    m->seq < 0 || m->seq >= cfg->msgs || 
+	    (m->size > (int)sizeof(msg_t) && p[m->size - 1] != (char)m->seq))
+	    w->valid = 0;
+	else
+	    __atomic_sub_fetch(&b->live, m->size, __ATOMIC_RELAXED);
+
+	t0 = get_tsc_serial();
+	if (cfg->libc)
+	    free(p);
+	else
+	    mm_free(p);
+	t1 = get_tsc_serial();
+	hist_record(&w->lat, (t1 - t0 > cfg->tsc_ovhd) ? 
+		    t1 - t0 - cfg->tsc_ovhd : 0);
+    }
+    w->end = wall_secs();
+    return NULL;
+}
+
+/*
+ * pc_run - Start the producers and consumers, let them all go at once,
+ *     and gather what they measured. The run time is from the first
+ *     thread starting to the last one being done.
+ */
+void pc_run(pc_config_t *cfg, pc_result_t *res)
+{
+    bench_t b;
+    worker_t *w;
+    pthread_t *tids;
+    double begin = DBL_MAX, end = 0;
+    int n = cfg->producers + cfg->consumers;
+    int i;
+
+    memset(res, 0, sizeof(*res));
+    hist_init(&res->malloc_lat);
+    hist_init(&res->free_lat);
+    res->valid = 1;
+    res->msgs = cfg->msgs * cfg->producers;
+
+    if (!cfg->libc) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    pc_error("mm_init failed");
+	mm_set_threaded(1);
+    }
+
+    b.cfg = cfg;
+    b.live = 0;
+    b.res = res;
+    w = (worker_t *)calloc(n, sizeof(worker_t));
+    tids = (pthread_t *)malloc(n * sizeof(pthread_t));
+    b.queues = (queue_t *)calloc(cfg->consumers, sizeof(queue_t));
+    if (w == NULL || tids == NULL || b.queues == NULL)
+	pc_error("out of memory");
+    for (i = 0; i < cfg->consumers; i++) {
+	pthread_mutex_init(&b.queues[i].lock, NULL);
+	pthread_cond_init(&b.queues[i].nonempty, NULL);
+	pthread_cond_init(&b.queues[i].nonfull, NULL);
+    }
+    pthread_barrier_init(&b.start, NULL, n + 1);
+
+    /* Producers come first in w and tids, then the consumers */
+    for (i = 0; i < n; i++) {
+	w[i].b = &b;
+	w[i].id = (i < cfg->producers) ? i : i - cfg->producers;
+	w[i].valid = 1;
+	hist_init(&w[i].lat);
+	if (pthread_create(&tids[i], NULL, 
+			   (i < cfg->producers) ? producer : consumer, &w[i]))
+	    pc_error("pthread_create failed");
+    }
+    pthread_barrier_wait(&b.start);
+    for (i = 0; i < cfg->producers; i++)
+	pthread_join(tids[i], NULL);
+    for (i = 0; i < cfg->consumers; i++)
+	put_msg(&b.queues[i], NULL);
+    for (i = cfg->producers; i < n; i++)
+	pthread_join(tids[i], NULL);
+
+    for (i = 0; i < n; i++) {
+	begin = MIN(begin, w[i].begin);
+	end = MAX(end, w[i].end);
+	res->valid &= w[i].valid;
+	hist_merge((i < cfg->producers) ? &res->malloc_lat : &res->free_lat,
+		   &w[i].lat);
+    }
+    res->secs = end - begin;
+
+    /* The heap once every message is freed */
+    res->samples[res->nsamples].secs = end - w[0].begin;
+    res->samples[res->nsamples].sent = cfg->msgs;
+    res->samples[res->nsamples].heap = heap_bytes(cfg->libc);
+    res->samples[res->nsamples].live = b.live;
+    res->nsamples++;
+
+    if (!cfg->libc)
+	mm_set_threaded(0);
+    for (i = 0; i < cfg->consumers; i++) {
+	pthread_mutex_destroy(&b.queues[i].lock);
+	pthread_cond_destroy(&b.queues[i].nonempty);
+	pthread_cond_destroy(&b.queues[i].nonfull);
+    }
+    pthread_barrier_destroy(&b.start);
+    free(b.queues);
+    free(tids);
+    free(w);
+}
+
+/*
+ * pc_print - Print the throughput, the latency percentiles in cycles and
+ *     the heap samples of a run
+ */
+void pc_print(char *name, pc_result_t *res)
+{
+    hist_t *h;
+    pc_sample_t *sp;
+    int i;
+
+    printf("\nProducer/consumer results for %s:\n", name);
+    if (!res->valid) {
+	printf("ERROR: some messages were damaged before they were freed\n");
+	return;
+    }
+    printf("%ld messages in %.6f secs: %.0f Kmsgs/s\n", 
+	   res->msgs, res->secs, (res->msgs/1e3)/res->secs);
+
+    printf("%-8s%9s%8s%8s%8s%8s%10s\n", 
+	   "request", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < 2; i++) {
+	h = (i == 0) ? &res->malloc_lat : &res->free_lat;
+	printf("%-8s%9llu%8llu%8llu%8llu%8llu%10llu\n", 
+	       (i == 0) ? "malloc" : "free",
+	       h->total,
+	       hist_percentile(h, 50.0),
+	       hist_percentile(h, 90.0),
+	       hist_percentile(h, 99.0),
+	       hist_percentile(h, 99.9),
+	       h->max);
+    }
+
+    printf("%10s%10s%12s%12s\n", "secs", "sent", "heap", "live");
+    for (i = 0; i < res->nsamples; i++) {
+	sp = &res->samples[i];
+	if (sp->heap != 0)
+	    printf("%10.6f%10ld%12zu%12zu\n", sp->secs, sp->sent, sp->heap, 
+		   sp->live);
+	else
+	    printf("%10.6f%10ld%12s%12zu\n", sp->secs, sp->sent, "-", sp->live);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * pcbench.h - Producer/consumer benchmark of cross-thread frees
+ *
+ * Producer threads allocate messages of sampled sizes and pass them
+ * through bounded queues to consumer threads, which free them. Every
+ * block is thus freed by a thread other than the one that allocated
+ * it. A run reports its throughput, the latency of each malloc and
+ * free, and how the heap and the bytes in flight grew over time.
+ *
+ * Include hist.h before this file.
+ */
+
+#define PC_QUEUE    1024   /* messages each consumer's queue holds */
+#define PC_SAMPLES  16     /* heap samples taken over a run */
+#define PC_MIN_SIZE 16     /* smallest message; it holds a header */
+#define PC_MAX_SIZE 4096   /* largest message */
+
+/* The shape of a run */
+typedef struct {
+    int producers;     /* producer threads */
+    int consumers;     /* consumer threads, each with its own queue */
+    long msgs;         /* messages each producer sends */
+    int libc;          /* use libc malloc instead of the mm package */
+    unsigned long long tsc_ovhd; /* cycles to take off each latency */
+} pc_config_t;
+
+/* The state of the heap at one point in a run */
+typedef struct {
+    double secs;       /* since the run started */
+    long sent;         /* messages the first producer had sent */
+    size_t heap;       /* bytes of heap, 0 if unknown */
+    size_t live;       /* bytes allocated and not yet freed */
+} pc_sample_t;
+
+/* What a run measured */
+typedef struct {
+    int valid;         /* did every message arrive intact? */
+    double secs;       /* wall time of the whole run */
+    long msgs;         /* messages sent */
+    hist_t malloc_lat; /* cycles per malloc, over all producers */
+    hist_t free_lat;   /* cycles per free, over all consumers */
+    int nsamples;
+    pc_sample_t samples[PC_SAMPLES + 1];
+} pc_result_t;
+
+/* Run the benchmark described by cfg. For the mm package, the heap
+   must have been set up with mem_init; it is reset and mm_init called. */
+void pc_run(pc_config_t *cfg, pc_result_t *res);
+
+/* Print the results of a run under the heading name */
+void pc_print(char *name, pc_result_t *res);
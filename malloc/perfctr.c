@@ -0,0 +1,143 @@
+/*
+ * perfctr.c - Hardware performance counters through perf_event_open
+ *
+ * The counters exclude the kernel and hypervisor, which both keeps the
+ * counts to the allocator's own work and lets them be opened at the
+ * default perf_event_paranoid level. The page fault counter is the
+ * exception: it is counted by the kernel, and is often the only one a
+ * virtual machine without a PMU can open.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+#define CACHE_MISS(cache) (PERF_COUNT_HW_CACHE_ ## cache | \
+			   (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+			   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* What each counter counts */
+static struct {
+    char *name;
+    unsigned int type;
+    unsigned long long config;
+} events[PERFCTR_N] = {
+    { "instr",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cycles",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "L1d-miss", PERF_TYPE_HW_CACHE, CACHE_MISS(L1D) },
+    { "LLC-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "dTLB-miss",PERF_TYPE_HW_CACHE, CACHE_MISS(DTLB) },
+    { "br-miss",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "faults",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int fds[PERFCTR_N];     /* -1 for counters that are not open */
+static pid_t owner = 0;        /* the process they were opened in */
+
+/*
+ * perfctr_open - Open each counter, or reuse the ones already open. A
+ *     forked child has its parent's descriptors, which count the
+ *     parent, so it opens its own.
+ */
+int perfctr_open(char **why)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+    int err = 0;
+
+    if (owner == getpid()) {
+	for (i = 0; i < PERFCTR_N; i++)
+	    n += (fds[i] >= 0);
+	return n;
+    }
+    if (owner != 0)
+	for (i = 0; i < PERFCTR_N; i++)
+	    if (fds[i] >= 0)
+		close(fds[i]);
+    owner = getpid();
+
+    for (i = 0; i < PERFCTR_N; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = (events[i].type != PERF_TYPE_SOFTWARE);
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] >= 0)
+	    n++;
+	else if (err == 0)
+	    err = errno;
+    }
+    if (n == 0 && why != NULL)
+	*why = strerror(err);
+    return n;
+}
+
+/*
+ * perfctr_start - Zero and start the open counters
+ */
+void perfctr_start(void)
+{
+    int i;
+
+    if (owner != getpid())
+	return;
+    for (i = 0; i < PERFCTR_N; i++)
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/*
+ * perfctr_stop - Stop the counters and read them. A counter that only
+ *     ran for part of the time it was enabled is scaled up to all of it.
+ */
+void perfctr_stop(perfctr_t *pc)
+{
+    unsigned long long buf[3];   /* value, time enabled, time running */
+    int i;
+
+    perfctr_clear(pc);
+    if (owner != getpid())
+	return;
+    for (i = 0; i < PERFCTR_N; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PERFCTR_N; i++) {
+	if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+	    continue;
+	if (buf[2] == 0)
+	    pc->count[i] = 0;
+	else
+	    pc->count[i] = (double)buf[0] * buf[1] / buf[2];
+    }
+}
+
+/*
+ * perfctr_clear - Mark every count of *pc as not measured
+ */
+void perfctr_clear(perfctr_t *pc)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_N; i++)
+	pc->count[i] = -1;
+}
+
+/*
+ * perfctr_name - Short name of counter i
+ */
+char *perfctr_name(int i)
+{
+    return events[i].name;
+}
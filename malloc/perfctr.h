@@ -0,0 +1,40 @@
+/*
+ * perfctr.h - Hardware performance counters through perf_event_open
+ *
+ * Each counter is opened on its own, for the calling process in user
+ * mode, so that any the kernel or machine lacks are simply left out.
+ * When the kernel has to share the hardware among more counters than
+ * it has, the counts are scaled up from the time each one ran.
+ */
+
+/* The counters, in the order of their counts */
+#define PERFCTR_INSTR     0   /* instructions retired */
+#define PERFCTR_CYCLES    1   /* CPU cycles */
+#define PERFCTR_L1D_MISS  2   /* L1 data cache read misses */
+#define PERFCTR_LLC_MISS  3   /* last level cache misses */
+#define PERFCTR_DTLB_MISS 4   /* data TLB read misses */
+#define PERFCTR_BR_MISS   5   /* mispredicted branches */
+#define PERFCTR_FAULTS    6   /* page faults (a software counter) */
+#define PERFCTR_N         7
+
+/* The counts of one measurement, -1 for a counter that is not open */
+typedef struct {
+    double count[PERFCTR_N];
+} perfctr_t;
+
+/* Open the counters for this process, if it has not already, and
+   return how many could be opened. When none could, *why is set to
+   the reason the first one failed. */
+int perfctr_open(char **why);
+
+/* Zero and start the open counters */
+void perfctr_start(void);
+
+/* Stop the counters and read their counts into *pc */
+void perfctr_stop(perfctr_t *pc);
+
+/* Mark every count of *pc as not measured */
+void perfctr_clear(perfctr_t *pc);
+
+/* Short name of counter i, for reports */
+char *perfctr_name(int i);
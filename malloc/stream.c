@@ -0,0 +1,526 @@
+/*
+ * stream.c - Compressed trace files that are replayed as a stream
+ *
+ * The file is a header followed by blocks, with every fixed-width
+ * field stored little-endian:
+ *
+ *   magic[8] version:4 weight:4 sugg_heapsize:8 num_ids:8
+ *   num_ops:8 num_objs:8
+ *
+ *   nops:4 raw_len:4 comp_len:4 data[comp_len]     (repeated)
+ *
+ * data inflates to raw_len bytes holding nops requests. Each request
+ * is a type byte, the zigzagged difference between its id and the id
+ * of the request before it in the block, and then the request's size,
+ * count and alignment as varints, for the types that have them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "trace.h"
+#include "stream.h"
+
+#define STREAM_VERSION 2
+#define HDR_BYTES      48           /* bytes in the file header */
+#define BLK_BYTES      12           /* bytes in a block header */
+#define OP_MAX_BYTES   (1 + 4 * 10) /* a type byte and four 64-bit varints */
+#define RAW_MAX        (STREAM_CHUNK * OP_MAX_BYTES)
+
+/* Which fields follow the id of each request type */
+#define HAS_SIZE(t)  ((t) == ALLOC || (t) == REALLOC || (t) == CALLOC || \
+		      (t) == MEMALIGN || (t) == ALLOC_BATCH)
+#define HAS_COUNT(t) ((t) == ALLOC_BATCH || (t) == FREE_BATCH)
+#define HAS_ALIGN(t) ((t) == MEMALIGN)
+
+/* Map signed id differences to small unsigned numbers and back */
+#define ZIGZAG(d)    (((unsigned long)(d) << 1) ^ (unsigned long)((d) >> 63))
+#define UNZIGZAG(z)  ((long)((z) >> 1) ^ -(long)((z) & 1))
+
+struct stream {
+    FILE *fp;
+    char *path;
+    stream_info_t info;
+    long ops_read;                  /* requests decoded so far */
+    unsigned char *raw;             /* an inflated block */
+    unsigned char *comp;            /* a compressed block */
+    uLong comp_max;                 /* size of comp */
+
+    pthread_t decoder;
+    pthread_mutex_t lock;           /* guards the fields below */
+    pthread_cond_t filled;          /* a block was decoded, or the end */
+    pthread_cond_t drained;         /* the driver handed a block back */
+    traceop_t *ring[STREAM_RING];   /* decoded blocks... */
+    int ring_n[STREAM_RING];        /* ... and their numbers of requests */
+    int head;                       /* oldest decoded block */
+    int count;                      /* decoded blocks in the ring */
+    int held;                       /* the driver holds the head block */
+    int done;                       /* the decoder reached the end */
+    int quit;                       /* the driver wants the decoder gone */
+};
+
+/*
+ * stream_error - Report a bad or unreadable stream trace and exit
+ */
+static void stream_error(char *path, char *msg)
+{
+    fprintf(stderr, "ERROR: stream trace %s: %s\n", path, msg);
+    exit(1);
+}
+
+/*
+ * put32, put64, get32, get64 - Little-endian fixed-width fields
+ */
+static void put32(unsigned char *p, unsigned int v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put64(unsigned char *p, unsigned long long v)
+{
+    put32(p, (unsigned int)v);
+    put32(p + 4, (unsigned int)(v >> 32));
+}
+
+static unsigned int get32(unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned long long get64(unsigned char *p)
+{
+    return get32(p) | ((unsigned long long)get32(p + 4) << 32);
+}
+
+/*
+ * put_varint - Store v seven bits at a time, low bits first, and
+ *     return the byte after it
+ */
+static unsigned char *put_varint(unsigned char *p, unsigned long v)
+{
+    while (v >= 0x80) {
+	*p++ = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/*
+ * get_varint - Load the varint at *pp, which must end before end, and
+ *     advance *pp past it
+ */
+static unsigned long get_varint(stream_t *s, unsigned char **pp,
+				unsigned char *end)
+{
+    unsigned char *p = *pp;
+    unsigned long v = 0;
+    int shift = 0;
+
+    do {
+	if (p == end || shift > 63)
+	    stream_error(s->path, "corrupt request");
+	v |= (unsigned long)(*p & 0x7f) << shift;
+	shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+    return v;
+}
+
+/*
+ * decode_block - Read, inflate and decode the next block of the file
+ *     into ops. Returns the number of requests, or 0 at the end.
+ */
+static int decode_block(stream_t *s, traceop_t *ops)
+{
+    unsigned char blk[BLK_BYTES];
+    unsigned char *p, *end;
+    unsigned int n, raw_len, comp_len, i;
+    unsigned long v;
+    uLongf len;
+    long index = 0, count;
+    traceop_t *op;
+
+    if (fread(blk, 1, BLK_BYTES, s->fp) != BLK_BYTES) {
+	if (s->ops_read != s->info.num_ops)
+	    stream_error(s->path, "truncated");
+	return 0;
+    }
+    n = get32(blk);
+    raw_len = get32(blk + 4);
+    comp_len = get32(blk + 8);
+    if (n == 0 || n > STREAM_CHUNK || raw_len > RAW_MAX ||
+	comp_len > s->comp_max)
+	stream_error(s->path, "corrupt block header");
+    if (fread(s->comp, 1, comp_len, s->fp) != comp_len)
+	stream_error(s->path, "truncated");
+    len = raw_len;
+    if (uncompress(s->raw, &len, s->comp, comp_len) != Z_OK ||
+	len != raw_len)
+	stream_error(s->path, "corrupt block");
+
+    p = s->raw;
+    end = p + raw_len;
+    for (i = 0; i < n; i++) {
+	op = &ops[i];
+	if (p == end || *p >= NREQTYPES)
+	    stream_error(s->path, "corrupt request");
+	op->type = *p++;
+	v = get_varint(s, &p, end);
+	index += UNZIGZAG(v);
+	op->index = index;
+	op->size = HAS_SIZE(op->type) ? get_varint(s, &p, end) : 0;
+	count = HAS_COUNT(op->type) ? get_varint(s, &p, end) : 1;
+	if (HAS_ALIGN(op->type))
+	    op->align = get_varint(s, &p, end);
+	else
+	    op->count = count;
+
+	/* Every id the request names must have a slot */
+	if (index < 0 || index >= s->info.num_ids || count < 1 ||
+	    count > s->info.num_ids - index)
+	    stream_error(s->path, "request id out of range");
+    }
+    if (p != end)
+	stream_error(s->path, "corrupt block");
+    if ((s->ops_read += n) > s->info.num_ops)
+	stream_error(s->path, "more requests than the header says");
+    return n;
+}
+
+/*
+ * decoder - The decoder thread. Fills free ring slots with decoded
+ *     blocks until the end of the file or until the driver quits.
+ */
+static void *decoder(void *arg)
+{
+    stream_t *s = (stream_t *)arg;
+    int slot, n;
+
+    for (;;) {
+	pthread_mutex_lock(&s->lock);
+	while (s->count == STREAM_RING && !s->quit)
+	    pthread_cond_wait(&s->drained, &s->lock);
+	if (s->quit) {
+	    pthread_mutex_unlock(&s->lock);
+	    return NULL;
+	}
+	slot = (s->head + s->count) % STREAM_RING;
+	pthread_mutex_unlock(&s->lock);
+
+	/* The driver never touches a slot beyond count, so decode unlocked */
+	n = decode_block(s, s->ring[slot]);
+
+	pthread_mutex_lock(&s->lock);
+	if (n == 0)
+	    s->done = 1;
+	else {
+	    s->ring_n[slot] = n;
+	    s->count++;
+	}
+	pthread_cond_signal(&s->filled);
+	pthread_mutex_unlock(&s->lock);
+	if (n == 0)
+	    return NULL;
+    }
+}
+
+/*
+ * stream_probe - Does the file at path start with STREAM_MAGIC?
+ */
+int stream_probe(char *path)
+{
+    FILE *fp;
+    char magic[8];
+    int is_stream;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    is_stream = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+	memcmp(magic, STREAM_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return is_stream;
+}
+
+/*
+ * stream_open - Open the stream trace at path, read its header into
+ *     info and start the decoder thread
+ */
+stream_t *stream_open(char *path, stream_info_t *info)
+{
+    stream_t *s;
+    unsigned char hdr[HDR_BYTES];
+    int i;
+
+    if ((s = (stream_t *)calloc(1, sizeof(stream_t))) == NULL)
+	stream_error(path, "out of memory");
+    if ((s->fp = fopen(path, "r")) == NULL)
+	stream_error(path, "could not open");
+    if (fread(hdr, 1, HDR_BYTES, s->fp) != HDR_BYTES ||
+	memcmp(hdr, STREAM_MAGIC, 8) != 0 || get32(hdr + 8) != STREAM_VERSION)
+	stream_error(path, "not a stream trace of this version");
+    s->info.weight = get32(hdr + 12);
+    s->info.sugg_heapsize = get64(hdr + 16);
+    s->info.num_ids = get64(hdr + 24);
+    s->info.num_ops = get64(hdr + 32);
+    s->info.num_objs = get64(hdr + 40);
+    if (s->info.num_ids < 0 || s->info.num_ops < 0)
+	stream_error(path, "corrupt header");
+
+    s->path = strdup(path);
+    s->comp_max = compressBound(RAW_MAX);
+    s->raw = (unsigned char *)malloc(RAW_MAX);
+    s->comp = (unsigned char *)malloc(s->comp_max);
+    if (s->path == NULL || s->raw == NULL || s->comp == NULL)
+	stream_error(path, "out of memory");
+    for (i = 0; i < STREAM_RING; i++)
+	if ((s->ring[i] = (traceop_t *)malloc(STREAM_CHUNK *
+					      sizeof(traceop_t))) == NULL)
+	    stream_error(path, "out of memory");
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->filled, NULL);
+    pthread_cond_init(&s->drained, NULL);
+    if (pthread_create(&s->decoder, NULL, decoder, s) != 0)
+	stream_error(path, "could not start the decoder thread");
+
+    *info = s->info;
+    return s;
+}
+
+/*
+ * stream_next - Hand back the block returned by the previous call and
+ *     wait for the next one. Returns NULL at the end of the trace.
+ */
+traceop_t *stream_next(stream_t *s, long *n)
+{
+    traceop_t *ops = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->held) {
+	s->head = (s->head + 1) % STREAM_RING;
+	s->count--;
+	s->held = 0;
+	pthread_cond_signal(&s->drained);
+    }
+    while (s->count == 0 && !s->done)
+	pthread_cond_wait(&s->filled, &s->lock);
+    if (s->count > 0) {
+	s->held = 1;
+	ops = s->ring[s->head];
+	*n = s->ring_n[s->head];
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ops;
+}
+
+/*
+ * stream_close - Stop the decoder thread and release the stream
+ */
+void stream_close(stream_t *s)
+{
+    int i;
+
+    pthread_mutex_lock(&s->lock);
+    s->quit = 1;
+    pthread_cond_signal(&s->drained);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->decoder, NULL);
+
+    pthread_cond_destroy(&s->drained);
+    pthread_cond_destroy(&s->filled);
+    pthread_mutex_destroy(&s->lock);
+    for (i = 0; i < STREAM_RING; i++)
+	free(s->ring[i]);
+    free(s->comp);
+    free(s->raw);
+    free(s->path);
+    fclose(s->fp);
+    free(s);
+}
+
+/*
+ * renumber - Copy the requests, moving each id to a free slot when
+ *     its block is allocated and freeing the slot again with the block.
+ *     A batch needs consecutive slots, so it takes them from a run that
+ *     an earlier batch free left behind, or else fresh ones. A batch
+ *     free must find its blocks in consecutive slots. Returns NULL,
+ *     leaving the ids alone, if the trace doesn't allow that.
+ */
+static traceop_t *renumber(traceop_t *ops, long num_ops, stream_info_t *info)
+{
+    long num_ids = info->num_ids;
+    long *slot, *free_slots, *run_base, *run_len;
+    long nfree = 0, nruns = 0, top = 0;
+    long i, j, r, id, count, base;
+    int ok = 1;
+    traceop_t *out;
+
+    slot = (long *)malloc(num_ids * sizeof(long));
+    free_slots = (long *)malloc(num_ids * sizeof(long));
+    run_base = (long *)malloc(num_ids * sizeof(long));
+    run_len = (long *)malloc(num_ids * sizeof(long));
+    out = (traceop_t *)malloc(num_ops * sizeof(traceop_t));
+    if (slot == NULL || free_slots == NULL || run_base == NULL ||
+	run_len == NULL || out == NULL) {
+	fprintf(stderr, "ERROR: out of memory in renumber\n");
+	exit(1);
+    }
+    for (i = 0; i < num_ids; i++)
+	slot[i] = -1;
+
+    for (i = 0; ok && i < num_ops; i++) {
+	out[i] = ops[i];
+	id = ops[i].index;
+	count = ops[i].count;
+	switch (ops[i].type) {
+
+	case ALLOC:
+	case REALLOC:
+	case CALLOC:
+	case MEMALIGN:
+	    if (slot[id] < 0) {
+		if (nfree > 0)
+		    slot[id] = free_slots[--nfree];
+		else if (top < num_ids)
+		    slot[id] = top++;
+		else
+		    ok = 0;
+	    }
+	    out[i].index = slot[id];
+	    break;
+
+	case FREE:
+	case FREE_SIZED:
+	    if ((out[i].index = slot[id]) < 0)
+		ok = 0;
+	    else {
+		free_slots[nfree++] = slot[id];
+		slot[id] = -1;
+	    }
+	    break;
+
+	case ALLOC_BATCH:
+	    for (r = nruns - 1; r >= 0 && run_len[r] < count; r--)
+		;
+	    if (r >= 0) {              /* the front of a free run */
+		base = run_base[r];
+		run_base[r] += count;
+		if ((run_len[r] -= count) == 0) {
+		    run_base[r] = run_base[--nruns];
+		    run_len[r] = run_len[nruns];
+		}
+	    }
+	    else if (top + count <= num_ids) {
+		base = top;
+		top += count;
+	    }
+	    else
+		base = -1;
+	    if (base < 0)
+		ok = 0;
+	    for (j = 0; ok && j < count; j++) {
+		if (slot[id + j] >= 0)
+		    ok = 0;
+		slot[id + j] = base + j;
+	    }
+	    out[i].index = base;
+	    break;
+
+	case FREE_BATCH:
+	    for (j = 0; ok && j < count; j++)
+		if (slot[id + j] < 0 || slot[id + j] != slot[id] + j)
+		    ok = 0;
+	    out[i].index = slot[id];
+	    if (ok) {
+		run_base[nruns] = slot[id];
+		run_len[nruns++] = count;
+		for (j = 0; j < count; j++)
+		    slot[id + j] = -1;
+	    }
+	    break;
+	}
+    }
+
+    free(run_len);
+    free(run_base);
+    free(free_slots);
+    free(slot);
+    if (!ok) {
+	free(out);
+	return NULL;
+    }
+    info->num_ids = top;
+    return out;
+}
+
+/*
+ * stream_write - Write the requests in ops to path as a stream trace,
+ *     renumbering their ids first if the trace allows it
+ */
+void stream_write(char *path, stream_info_t *info, traceop_t *ops,
+		  long num_ops)
+{
+    FILE *fp;
+    traceop_t *remapped, *op;
+    unsigned char hdr[HDR_BYTES], blk[BLK_BYTES];
+    unsigned char *raw, *comp, *p;
+    uLongf comp_len;
+    long i, j, n, index;
+
+    if ((remapped = renumber(ops, num_ops, info)) != NULL)
+	ops = remapped;
+    raw = (unsigned char *)malloc(RAW_MAX);
+    comp = (unsigned char *)malloc(compressBound(RAW_MAX));
+    if (raw == NULL || comp == NULL)
+	stream_error(path, "out of memory");
+    if ((fp = fopen(path, "w")) == NULL)
+	stream_error(path, "could not create");
+
+    memcpy(hdr, STREAM_MAGIC, 8);
+    put32(hdr + 8, STREAM_VERSION);
+    put32(hdr + 12, info->weight);
+    put64(hdr + 16, info->sugg_heapsize);
+    put64(hdr + 24, info->num_ids);
+    put64(hdr + 32, num_ops);
+    put64(hdr + 40, info->num_objs);
+    if (fwrite(hdr, 1, HDR_BYTES, fp) != HDR_BYTES)
+	stream_error(path, "write failed");
+
+    for (i = 0; i < num_ops; i += n) {
+	n = (num_ops - i < STREAM_CHUNK) ? num_ops - i : STREAM_CHUNK;
+	p = raw;
+	index = 0;
+	for (j = 0; j < n; j++) {
+	    op = &ops[i + j];
+	    *p++ = op->type;
+	    p = put_varint(p, ZIGZAG(op->index - index));
+	    index = op->index;
+	    if (HAS_SIZE(op->type))
+		p = put_varint(p, op->size);
+	    if (HAS_COUNT(op->type))
+		p = put_varint(p, op->count);
+	    if (HAS_ALIGN(op->type))
+		p = put_varint(p, op->align);
+	}
+
+	comp_len = compressBound(RAW_MAX);
+	if (compress2(comp, &comp_len, raw, p - raw, Z_DEFAULT_COMPRESSION)
+	    != Z_OK)
+	    stream_error(path, "compress failed");
+	put32(blk, n);
+	put32(blk + 4, p - raw);
+	put32(blk + 8, comp_len);
+	if (fwrite(blk, 1, BLK_BYTES, fp) != BLK_BYTES ||
+	    fwrite(comp, 1, comp_len, fp) != comp_len)
+	    stream_error(path, "write failed");
+    }
+    if (fclose(fp) != 0)
+	stream_error(path, "write failed");
+
+    free(comp);
+    free(raw);
+    free(remapped);
+}
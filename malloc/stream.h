@@ -0,0 +1,49 @@
+/*
+ * stream.h - Compressed trace files that are replayed as a stream
+ *
+ * A stream trace holds its requests in zlib-compressed blocks of up to
+ * STREAM_CHUNK requests, with each id stored as the difference from the
+ * one before and sizes as varints. It is never loaded whole: a decoder
+ * thread inflates the blocks into a ring of STREAM_RING request arrays,
+ * and the driver takes them one at a time with stream_next. Ids are
+ * renumbered to reuse the slots of freed blocks, so num_ids is the
+ * most blocks ever live at once rather than the number of requests.
+ *
+ * Include trace.h before this file.
+ */
+
+#define STREAM_MAGIC  "MMSTREAM"  /* first 8 bytes of every stream trace */
+#define STREAM_CHUNK  65536       /* requests per compressed block */
+#define STREAM_RING   4           /* decoded blocks buffered ahead */
+
+/* The header of a stream trace */
+typedef struct {
+    size_t sugg_heapsize;  /* suggested heap size */
+    long num_ids;          /* number of id slots the requests use */
+    int weight;            /* weight for this trace (unused) */
+    long num_ops;          /* number of requests */
+    long num_objs;         /* number of blocks touched by those requests */
+} stream_info_t;
+
+typedef struct stream stream_t;
+
+/* Does the file at path start with STREAM_MAGIC? */
+int stream_probe(char *path);
+
+/* Open the stream trace at path, fill in info from its header and
+   start decoding it in the background */
+stream_t *stream_open(char *path, stream_info_t *info);
+
+/* Hand back the block from the previous call and wait for the next
+   one. Returns its requests and sets *n to their number, or returns
+   NULL at the end of the trace. */
+traceop_t *stream_next(stream_t *s, long *n);
+
+/* Stop the decoder and release the stream */
+void stream_close(stream_t *s);
+
+/* Write the num_ops requests in ops to path as a stream trace. The
+   ids are renumbered first when that can be done; info->num_ids is
+   updated to the number of slots used. */
+void stream_write(char *path, stream_info_t *info, traceop_t *ops,
+		  long num_ops);
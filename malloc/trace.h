@@ -0,0 +1,19 @@
+/*
+ * trace.h - The request record shared by mdriver and the trace readers
+ */
+
+/* Characterizes a single trace operation (allocator request). No request
+   has both a count and an alignment, so they share a field, which keeps
+   a record to 24 bytes on 64-bit hosts. */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC,       /* type of request */
+	  ALLOC_BATCH, FREE_BATCH, FREE_SIZED, MEMALIGN, CALLOC} type;
+    union {
+	int count;                    /* number of ids in a batch request */
+	int align;                    /* alignment of a memalign request */
+    };
+    long index;                       /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc request */
+} traceop_t;
+
+#define NREQTYPES (CALLOC + 1)        /* number of request types */
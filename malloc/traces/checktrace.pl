@@ -81,6 +81,35 @@ while ($line = <STDIN>) {
     # save the line for output later
     $lines[$requestnum++] = $line;
 
+    # batch requests stand for one alloc or free per id in id..id+count-1
+    if ($cmd eq "A" or $cmd eq "F") {
+	$count = $size;
+	for ($bid = $id; $bid < $id + $count; $bid++) {
+	    if ($cmd eq "A" and exists($HASH{$bid})) {
+		die "$0: ERROR[$linenum]: batch allocate reuses ID $bid.\n";
+	    }
+	    if ($cmd eq "F" and $HASH{$bid} ne "a" and $HASH{$bid} ne "r") {
+		die "$0: ERROR[$linenum]: batch free of unallocated block.\n";
+	    }
+	    if ($cmd eq "F") {
+		delete $HASH{$bid};
+	    }
+	    else {
+		$HASH{$bid} = "a";
+	    }
+	}
+	next;
+    }
+
+    # a sized free is checked like any other free, and a memalign or
+    # calloc like an alloc
+    if ($cmd eq "s") {
+	$cmd = "f";
+    }
+    if ($cmd eq "m" or $cmd eq "c") {
+	$cmd = "a";
+    }
+
     #ignore realloc requests, as long as they are preceeded by an alloc request
     if ($cmd eq "r") {
 	if (!$HASH{$id}) {
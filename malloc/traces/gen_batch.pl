@@ -0,0 +1,74 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+#
+# Generates two traces with the same objects: batch.rep, which
+# allocates and frees them in batches of $batch_size with the A and F
+# requests, and batch-single.rep, which issues one a or f request per
+# object. Comparing the two measures the per-object cost of the batch
+# interface against individual calls.
+#
+$batch_filename = "batch.rep";
+$single_filename = "batch-single.rep";
+$batch_size = 128;
+$num_batches = 200;
+$max_live = 4;                    # batches alive at any time
+@sizes = (8, 16, 24, 40, 64, 100, 200);
+
+# Build the list of batch requests
+$total_block_size = 0;
+@live = ();
+for ($i = 0;  $i < $num_batches; $i += 1) {
+    $size = $sizes[int(rand @sizes)];
+    $id = $i * $batch_size;
+    push @trace, "A $id $batch_size $size";
+    push @live, $id;
+    $total_block_size += $size * $batch_size;
+    if (@live > $max_live) {
+        $fid = shift @live;
+        push @trace, "F $fid $batch_size";
+    }
+}
+
+foreach $fid (@live) {
+    push @trace, "F $fid $batch_size";
+}
+
+# Calculate misc parameters
+$suggested_heap_size = $total_block_size + 100;
+$num_blocks = $num_batches * $batch_size;
+
+# Write the batch version
+open OUTFILE, ">$batch_filename" or die "Cannot create $batch_filename\n";
+$num_ops = @trace;
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+foreach $req (@trace) {
+    print OUTFILE "$req\n";
+}
+close OUTFILE;
+
+# Write the version with one request per object
+open OUTFILE, ">$single_filename" or die "Cannot create $single_filename\n";
+$num_ops = 0;
+foreach $req (@trace) {
+    ($cmd, $id, $count) = split(" ", $req);
+    $num_ops += $count;
+}
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+foreach $req (@trace) {
+    ($cmd, $id, $count, $size) = split(" ", $req);
+    for ($j = $id;  $j < $id + $count; $j += 1) {
+        if ($cmd eq "A") {
+            print OUTFILE "a $j $size\n";
+        } else {
+            print OUTFILE "f $j\n";
+        }
+    }
+}
+close OUTFILE;
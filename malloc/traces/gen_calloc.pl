@@ -0,0 +1,52 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+#
+# Generates calloc.rep: calloc requests freed in random order, so some
+# blocks come from fresh heap and some reuse freed memory. One block in
+# fifty is large (64KB to 1MB) to exercise zeroing of big blocks.
+#
+$out_filename = "calloc.rep";
+$num_blocks = 2400;
+$max_blk_size = 2048;
+$max_live = 200;                  # free the oldest beyond this many
+
+# Make a series of calloc()s, each freed at some later random point
+$total_block_size = 0;
+@live = ();
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    if (rand() < 0.02) {
+        $size = 65536 + int(rand(1048576 - 65536));
+    } else {
+        $size = int(rand $max_blk_size) + 1;
+    }
+    push @trace, "c $i $size";
+    push @live, $i;
+    $total_block_size += $size;
+    while (@live > $max_live or (@live and rand() < 0.45)) {
+        $pos = int(rand @live);
+        $fid = splice @live, $pos, 1;
+        push @trace, "f $fid";
+    }
+}
+foreach $fid (@live) {
+    push @trace, "f $fid";
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters
+$suggested_heap_size = $total_block_size + 100;
+$num_ops = 2*$num_blocks;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+foreach $req (@trace) {
+    print OUTFILE "$req\n";
+}
+
+close OUTFILE;
@@ -0,0 +1,81 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+#
+# Generates large.rep: small objects churning around a few huge ones,
+# like a cache process that keeps multi-GB arenas. Some huge blocks are
+# over 4GB and some are later shrunk in place with realloc, so the trace
+# needs 64-bit sizes throughout. The suggested heap size in the header
+# is what mdriver maps for the mm heap. Only the ends of each huge block
+# are ever written, so the pages touched stay small.
+#
+$out_filename = "large.rep";
+$num_small = 20000;
+$max_small_size = 4096;
+$max_small_live = 2000;
+$huge_every = 2000;               # one huge block per this many smalls
+$max_huge_live = 3;
+@huge_sizes = (1610612736, 3221225472, 4831838208, 6442450944);
+
+$id = 0;
+$num_ops = 0;
+$live_size = 0;
+$max_live_size = 0;
+@small = ();
+@huge = ();
+for ($i = 0;  $i < $num_small; $i += 1) {
+    if ($i % $huge_every == 0) {
+        $size = $huge_sizes[int(rand @huge_sizes)] + int(rand 4096);
+        push @trace, "a $id $size";
+        push @huge, $id;
+        $sizes{$id} = $size;
+        $live_size += $size;
+        $id++;
+        if (@huge > $max_huge_live) {
+            $fid = shift @huge;
+            push @trace, "f $fid";
+            $live_size -= $sizes{$fid};
+        }
+        elsif (@huge > 1 and rand() < 0.5) {
+            $rid = $huge[0];
+            $size = int($sizes{$rid} / 2);
+            push @trace, "r $rid $size";
+            $live_size -= $sizes{$rid} - $size;
+            $sizes{$rid} = $size;
+        }
+    }
+    $size = int(rand $max_small_size) + 1;
+    push @trace, "a $id $size";
+    push @small, $id;
+    $sizes{$id} = $size;
+    $live_size += $size;
+    $id++;
+    $max_live_size = $live_size if $live_size > $max_live_size;
+    while (@small > $max_small_live or (@small and rand() < 0.45)) {
+        $pos = int(rand @small);
+        $fid = splice @small, $pos, 1;
+        push @trace, "f $fid";
+        $live_size -= $sizes{$fid};
+    }
+}
+foreach $fid (@small, @huge) {
+    push @trace, "f $fid";
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Leave room for fragmentation around the huge blocks
+$suggested_heap_size = 4 * $max_live_size;
+$num_ops = @trace;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$id\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+foreach $req (@trace) {
+    print OUTFILE "$req\n";
+}
+
+close OUTFILE;
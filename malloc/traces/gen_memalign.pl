@@ -0,0 +1,53 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+#
+# Generates memalign.rep: random malloc and memalign requests, the
+# latter with power-of-two alignments up to a page, freed in random
+# order.
+#
+$out_filename = "memalign.rep";
+$num_blocks = 2400;
+$max_blk_size = 1024;
+@aligns = (32, 64, 128, 256, 4096);
+
+# Make a series of malloc()s and memalign()s
+$total_block_size = 0;
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    $size = int(rand $max_blk_size) + 1;
+    if (rand() < 0.5) {
+        $align = $aligns[int(rand @aligns)];
+        push @trace, "m $i $align $size";
+    } else {
+        push @trace, "a $i $size";
+    }
+    $total_block_size += $size;
+}
+
+# Insert each free() at a random point after its allocation
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    for ($pos = 0; $pos < @trace; $pos += 1) {
+        ($cmd, $id) = split(" ", $trace[$pos]);
+        last if ($cmd ne "f" and $id == $i);
+    }
+    $pos = $pos + 1 + int(rand(@trace - $pos));
+    splice @trace, $pos, 0, "f $i";
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters
+$suggested_heap_size = $total_block_size + 100;
+$num_ops = 2*$num_blocks;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+foreach $req (@trace) {
+    print OUTFILE "$req\n";
+}
+
+close OUTFILE;
@@ -0,0 +1,132 @@
+/*
+ * tsc.c - Function timer based on a calibrated time stamp counter
+ *
+ * Calibration counts ticks over a few TSC_CALIB_NS stretches of the raw
+ * monotonic clock, which NTP does not slew, and keeps the median rate.
+ * The overhead is the least that a pair of back-to-back reads has
+ * measured in TSC_OVHD_RUNS tries.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "clock.h"
+#include "tsc.h"
+
+#define TSC_CALIB_NS   20000000   /* 20 ms per calibration round */
+#define TSC_CALIB_RUNS 5
+#define TSC_OVHD_RUNS  1000
+#define TSC_MAX_RUNS   64         /* most runs ftimer_tsc keeps */
+
+static double hz = 0;             /* ticks per second */
+static int invariant = 0;
+static unsigned long long read_ovhd = 0;  /* ticks a pair of reads takes */
+
+#if defined(__x86_64__)
+/*
+ * raw_ns - Nanoseconds on the raw monotonic clock
+ */
+static unsigned long long raw_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+/*
+ * cmp_double - qsort order of doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * tsc_init - Find out whether the TSC is invariant (CPUID leaf
+ *     0x80000007, EDX bit 8), measure its rate and the read overhead
+ */
+void tsc_init(void)
+{
+    double rates[TSC_CALIB_RUNS];
+    unsigned long long t0, t1, n0, n1, d;
+    int i;
+
+#if defined(__x86_64__)
+    unsigned eax, ebx, ecx, edx;
+
+    invariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+	(edx & (1 << 8));
+    for (i = 0; i < TSC_CALIB_RUNS; i++) {
+	n0 = raw_ns();
+	t0 = get_tsc_serial();
+	do
+	    n1 = raw_ns();
+	while (n1 - n0 < TSC_CALIB_NS);
+	t1 = get_tsc_serial();
+	rates[i] = (t1 - t0) * 1e9 / (n1 - n0);
+    }
+    qsort(rates, TSC_CALIB_RUNS, sizeof(double), cmp_double);
+    hz = rates[TSC_CALIB_RUNS / 2];
+#else
+    invariant = 1;
+    hz = 1e9;
+#endif
+
+    read_ovhd = ~0ULL;
+    for (i = 0; i < TSC_OVHD_RUNS; i++) {
+	t0 = get_tsc_serial();
+	t1 = get_tsc_serial();
+	d = t1 - t0;
+	if (d < read_ovhd)
+	    read_ovhd = d;
+    }
+}
+
+/*
+ * tsc_hz, tsc_invariant, tsc_overhead - What tsc_init found
+ */
+double tsc_hz(void)
+{
+    return hz;
+}
+
+int tsc_invariant(void)
+{
+    return invariant;
+}
+
+unsigned long long tsc_overhead(void)
+{
+    return read_ovhd;
+}
+
+/*
+ * ftimer_tsc - Time n runs of f(argp) one by one and return the median
+ *     in seconds. Unlike the best of a few, the median does not reward
+ *     the one run that happened to dodge an interrupt.
+ */
+double ftimer_tsc(tsc_test_funct f, void *argp, int n)
+{
+    double secs[TSC_MAX_RUNS];
+    unsigned long long t0, t1;
+    int i;
+
+    if (n > TSC_MAX_RUNS)
+	n = TSC_MAX_RUNS;
+    for (i = 0; i < n; i++) {
+	t0 = get_tsc_serial();
+	f(argp);
+	t1 = get_tsc_serial();
+	secs[i] = ((t1 - t0 > read_ovhd) ? t1 - t0 - read_ovhd : 0) / hz;
+    }
+    qsort(secs, n, sizeof(double), cmp_double);
+    return (n % 2) ? secs[n/2] : (secs[n/2 - 1] + secs[n/2]) / 2;
+}
@@ -0,0 +1,29 @@
+/*
+ * tsc.h - Function timer based on a calibrated time stamp counter
+ *
+ * The counter is read with clock.c's get_tsc_serial, and its rate is
+ * measured against CLOCK_MONOTONIC_RAW rather than assumed to be the
+ * CPU clock. On an invariant TSC that rate does not change with the
+ * clock frequency or sleep states, so tick counts convert to seconds
+ * the same way on every run. Other machines read the monotonic clock
+ * itself, in nanoseconds.
+ */
+
+typedef void (*tsc_test_funct)(void *);
+
+/* Calibrate the counter and measure the cost of reading it. Must be
+   called before the other functions. */
+void tsc_init(void);
+
+/* Counter ticks per second */
+double tsc_hz(void);
+
+/* Does the counter run at a constant rate in all CPU states? */
+int tsc_invariant(void);
+
+/* Ticks that two back-to-back get_tsc_serial calls measure */
+unsigned long long tsc_overhead(void);
+
+/* Estimate the running time of f(argp) in seconds: the median of n
+   runs, less the timer's own overhead */
+double ftimer_tsc(tsc_test_funct f, void *argp, int n);
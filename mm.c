@@ -17,6 +17,7 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -41,14 +42,21 @@ team_t team = {
  * MACROS & CONSTANTS (from book)
  ********************************************************/
 
-/* single word (4) or double word (8) alignment */
+/* single word (4), double word (8) or quad word (16) alignment, as
+   config.h sets it */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+/* Block sizes are multiples of this: the alignment, but at least the
+   double word that keeps the low bits of a size free for the flags */
+#define BLKALIGN (MAX(ALIGNMENT, DSIZE))
+
 #define WSIZE       4       /* Word and header/footer size (bytes) */
 #define DSIZE       8       /* Double word size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */
@@ -149,11 +157,10 @@ void *mm_malloc(size_t size)
     if (size == 0)
         return NULL;
 
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-        asize = 2*DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+    /* Adjust block size to include overhead and alignment reqs. The
+       first payload starts 4 words into the heap, so blocks that are
+       multiples of BLKALIGN keep every payload aligned. */
+    asize = BLKALIGN * ((MAX(size + DSIZE, 2*DSIZE) + (BLKALIGN-1)) / BLKALIGN);
 
     /* Search the free list for a fit */
     if ((bp = find_fit(asize)) != NULL) {